@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Vm.hpp"
+
+// Runs many programs in one process: each one runs in its own Vm on a TaskPool thread with
+// its output and errors kept in memory, which are written in the order the programs were given
+class Batch
+{
+public:
+	// Runs the program in file on vm, avm's own messages going to out; returns its exit status
+	typedef std::function<int(Vm &vm, const char *file, std::ostream &out)>	t_Runner;
+
+	// Returns 0 when every program succeeded, 1 otherwise
+	static int run(std::vector<std::string> const & files, std::size_t jobs, t_Runner const & runner);
+	// Appends the program paths listed in a manifest, one per line, "-" reading the standard input
+	static bool readManifest(const char *path, std::vector<std::string> &files);
+
+	typedef struct s_Result
+	{
+		std::string	output;
+		std::string	errors;
+		int			status;
+		bool		done;
+
+	}	t_Result;
+
+	// Runs one program in a fresh Vm on this thread, keeping its output and errors in result
+	static void runProgram(const char *file, t_Runner const & runner, t_Result &result);
+
+private:
+	Batch(void);
+};
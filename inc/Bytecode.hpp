@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string_view>
+#include "Parser.hpp"
+
+/*
+** Compiled program file (.avmc), in the byte order recorded by the marker:
+**   header  magic "AVMC", u16 version, u16 instruction size, u32 byte order
+**           marker, u32 reserved, u64 instruction count, u64 FNV-1a checksum
+**   body    the t_ParsedInstr array exactly as the executor runs it
+*/
+class Bytecode
+{
+public:
+	static const uint16_t	version = 1;
+
+	// Looks at the first bytes of a file already read or mapped
+	static bool	isBytecode(std::string_view data);
+	static bool	write(t_Program const & program, const char *path, std::string &error);
+	// From bytes already read or mapped, name standing for their file in errors
+	static bool	load(std::string_view bytes, const char *name, t_Program &program, std::string &error);
+
+private:
+	Bytecode(void);
+};
@@ -1,24 +1,46 @@
 #pragma once
 
+#include <array>
+#include <ostream>
+#include <utility>
 #include "Operand.hpp"
+#include "OperandStack.hpp"
+#include "OutputBuffer.hpp"
 #include "Parser.hpp"
 
+class Jit;
+class AVMException;
+
+enum e_DumpFormat {DumpText, DumpJson, DumpBinary};
+
 class CommandsExecutor
 {
 public:
-	static CommandsExecutor& getInstance();
+	// Values are written to the output file descriptor, runtime errors to the errors stream
+	CommandsExecutor(int output, std::ostream &errors);
+	~CommandsExecutor(void);
 
-	void execute(std::list<t_ParsedInstr> &instructions);
+	void execute(t_Program const & instructions);
+	void execute(t_Program const & instructions, Jit const & jit);
+	void reserve(std::size_t capacity);
+	OutputBuffer &output(void) {return output_;}
+	OperandStack const &stack(void) const {return stack_;}
+	void setDumpFormat(e_DumpFormat format) {dumpFormat_ = format;}
+	void setErrorStream(std::ostream &errors) {errors_ = &errors;}
+
+	// Streaming: runs one instruction as soon as it is parsed, false once the program is over
+	bool executeNext(t_ParsedInstr const & instr);
+	void endOfInput(std::size_t line);
 
 private:
+	// Native code calls back into step() for everything it does not inline
+	friend class Jit;
 
 	CommandsExecutor	&operator=(CommandsExecutor const & rhs);
 	CommandsExecutor(CommandsExecutor const & rhs);
-	CommandsExecutor(void);
-	~CommandsExecutor(void);
 
-	void	push(const IOperand *operand);
-	void	assert(const IOperand *operand);
+	void	push(Value const & operand);
+	void	assert(Value const & operand);
 	void	pop();
 	void	swap();
 	void	dump();
@@ -31,8 +53,32 @@ private:
 	void	sort();
 	void	exit();
 
-	std::list<const IOperand *>	stack_;
-	bool						exit_;
-	const IOperand * 			right_;
-	const IOperand * 			left_;
+	void	dumpJson();
+	void	dumpBinary();
+
+	void	step(t_ParsedInstr const & instr);
+	void	reportError(AVMException & e, std::size_t line);
+
+	// Forms selected by StackAnalyzer: depth (and types) are already proven
+	void	assertUnchecked(Value const & operand);
+	void	printInt8();
+	template <typename L, typename R, e_Operation Op>
+	void	typedArith();
+
+	// Superinstructions chosen by InstructionFuser
+	template <e_Operation Op>
+	void	pushArith(Value const & operand);
+	void	swapSub();
+
+	typedef void (CommandsExecutor::*t_TypedArith)();
+	template <e_Operation Op, std::size_t... Types>
+	static std::array<t_TypedArith, 25> typedArithRow(std::index_sequence<Types...>);
+	// Indexed by opcode then by t_ParsedInstr::variant (lhs type * 5 + rhs type)
+	static const std::array<t_TypedArith, 25>	typedOps_[5];
+
+	OperandStack	stack_;
+	OutputBuffer	output_;
+	std::ostream	*errors_;
+	e_DumpFormat	dumpFormat_;
+	bool			exit_;
 };
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <ostream>
+#include "Parser.hpp"
+
+// Translates a program already rewritten by StackAnalyzer into a standalone C++17
+// translation unit: one statement per instruction on fixed stack slots, with the
+// operand types resolved at build time wherever the analysis proved them. The
+// runtime prelude follows the Value rules and error messages, so the built binary
+// prints exactly what avm would
+class CppEmitter
+{
+public:
+	static bool	write(t_Program const & program, const char *source, const char *path, std::string &error);
+
+private:
+	CppEmitter(void);
+
+	static void	emitInstruction(std::ostream &out, t_ParsedInstr const & instr, std::size_t depth);
+	static void	emitLiteral(std::ostream &out, t_ParsedInstr const & instr);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include "Batch.hpp"
+
+/*
+** Programs sent to a long-running avm over a Unix socket, integers in little-endian:
+**   request   u8 optimize, u8 jit, u8 dump format, u64 stack reserve,
+**             u64 length + file name (empty for the standard input),
+**             u64 length + program text or bytecode
+**   response  u32 exit status, u64 length + output, u64 length + errors
+** A connection carries any number of requests, each answered before the next is read.
+** Idle connections hold no thread: a worker only takes one when a request arrives on it
+*/
+class Daemon
+{
+public:
+	// Larger reserves are refused rather than letting one request exhaust the server
+	static const std::size_t	maxStackReserve = std::size_t(1) << 24;
+	// A request or a response stalled that long mid-way drops its connection
+	static const int			stallSeconds = 10;
+
+	typedef struct s_Request
+	{
+		bool			optimize;
+		bool			jit;
+		e_DumpFormat	dumpFormat;
+		std::size_t		stackReserve;
+		std::string		file;
+		std::string		program;
+
+	}	t_Request;
+
+	// Runs a received program on vm, avm's own messages going to out; returns its exit status
+	typedef std::function<int(Vm &vm, t_Request &request, std::ostream &out)>	t_Handler;
+
+	// Listens at path and runs every request in a fresh Vm on one of jobs threads;
+	// only returns when the socket can't be set up
+	static bool	serve(const char *path, std::size_t jobs, t_Handler const & handler, std::string &error);
+	// Sends one program to the server listening at path and waits for its result
+	static bool	request(const char *path, t_Request const & request, Batch::t_Result &result, std::string &error);
+
+private:
+	Daemon(void);
+
+	static void	workerLoop(int poller, int listener, t_Handler const & handler);
+	static void	acceptAll(int poller, int listener);
+	static bool	answerRequest(int fd, t_Handler const & handler);
+};
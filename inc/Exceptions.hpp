@@ -36,7 +36,13 @@ public:
 	virtual ~AVMException() noexcept;
 
 	static bool isError();
-	static void printErrors();
+	static void printErrors(std::ostream &out = std::cerr);
+	static const char* explain(e_ErrorType type);
+	static std::list<Error> takeErrors();
+	static void mergeErrors(std::list<Error> &merged, std::size_t lineOffset);
+	// Errors of this thread go to the given list from now on (its own list for nullptr);
+	// returns the list used until now
+	static std::list<Error> *collectErrors(std::list<Error> *errors);
 	const char* what() const noexcept;
 
 	void pushError(std::size_t line);
@@ -49,9 +55,13 @@ private:
 	AVMException	&operator=(AVMException const & rhs);
 
 	static void sortErrors();
+	static std::list<Error> &errors();
 
-	static std::list<Error>	errors_;
-	Error					current_errors_;
+	// Each thread collects its own errors, the main thread merges them; a Vm binds the
+	// thread it runs on to its own list
+	static thread_local std::list<Error>	threadErrors_;
+	static thread_local std::list<Error>	*errors_;
+	Error									current_errors_;
 };
 
 class InvalidTypeException : public AVMException
@@ -5,7 +5,7 @@
 # include <stdint.h>
 # include <float.h>
 
-enum	e_OperandType {Int8, Int16, Int32, Float, Double, NoType};
+enum	e_OperandType : uint8_t {Int8, Int16, Int32, Float, Double, NoType};
 
 class	IOperand
 {
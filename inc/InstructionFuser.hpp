@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Parser.hpp"
+
+// Load-time pass merging frequent instruction pairs into one dispatch:
+// push + add/sub/mul/div/mod, push + assert on an equal value and, once
+// StackAnalyzer has proven the swap, swap + sub. A fused instruction keeps the
+// line of the instruction that can fail, so errors are reported unchanged
+class InstructionFuser
+{
+public:
+	static void fuse(t_Program &program);
+
+private:
+	InstructionFuser(void);
+
+	static bool fusePair(t_ParsedInstr const & first, t_ParsedInstr const & second, t_ParsedInstr &fused);
+};
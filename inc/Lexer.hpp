@@ -2,31 +2,31 @@
 
 #include "Operand.hpp"
 #include <list>
+#include <string_view>
 
+// Views into the program text, which must outlive the token
 typedef struct s_LexToken
 {
-	std::string	instruction;
-	std::string	operandType;
-	std::string	literal;
-	std::size_t	line;
+	std::string_view	instruction;
+	std::string_view	operandType;
+	std::string_view	literal;
+	std::size_t			line;
 
 }	t_LexToken;
 
 class Lexer
 {
 public:
-	static Lexer& getInstance();
+	Lexer(void);
+	~Lexer(void);
 
-	std::list<t_LexToken> lexicalAnalisys(std::istream* input) const;
+	std::list<t_LexToken> lexicalAnalisys(std::string_view source) const;
+	bool nextToken(std::string_view &source, t_LexToken &token, std::size_t &line_number) const;
 
 private:
 
 	Lexer &operator=(Lexer const & rhs);
 	Lexer(Lexer const & rhs);
-	Lexer(void);
-	~Lexer(void);
-
-	void findOperandAndType(t_LexToken *token, std::string rest) const;
 
-	static Lexer * s_instance;
+	void findOperandAndType(t_LexToken *token, std::string_view rest) const;
 };
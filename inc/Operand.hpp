@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IOperand.hpp"
+#include "Value.hpp"
 
 template<typename T>
 class	Operand :	public IOperand
@@ -25,6 +26,7 @@ public:
 	int getPrecision(void) const;
 	e_OperandType getType(void) const;
 	std::string const & toString(void) const;
+	T getValue(void) const;
 
 private:
 
@@ -37,4 +39,7 @@ private:
 
 };
 
+template <typename R>
+R nativeValue(IOperand const & operand);
+
 #include "Operand.tpp"
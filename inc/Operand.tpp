@@ -1,8 +1,3 @@
-#include <sstream>
-#include <iomanip>
-#include <cmath>
-#include <limits>
-#include <type_traits>
 #include "Operand.hpp"
 #include "OperandFactory.hpp"
 #include "Exceptions.hpp"
@@ -11,33 +6,13 @@ template <typename T>
 Operand<T>::Operand() {}
 
 template <typename T>
-Operand<T>::Operand(T value) : value_(value), precision_(0)
+Operand<T>::Operand(T value) : value_(value)
 {
-	if (std::is_same<T, int8_t>::value)
-		type_ = Int8;
-	else if (std::is_same<T, int16_t>::value)
-		type_ = Int16;
-	else if (std::is_same<T, int32_t>::value)
-		type_ = Int32;
-	else if (std::is_same<T, float>::value)
-	{
-		type_ = Float;
-		precision_ = std::numeric_limits<float>::digits10;
-	}
-	else if (std::is_same<T, double>::value)
-	{
-		type_ = Double;
-		precision_ = std::numeric_limits<double>::digits10;
-	}
-	else
-		throw InvalidTypeException("");
-
-	std::ostringstream oss;
-	if (type_ < Float)
-		oss << std::to_string(value_);
-	else
-		oss << std::setprecision(precision_) << value_;
-	str_ = oss.str();
+	Value v(value_);
+
+	type_ = v.getType();
+	precision_ = v.getPrecision();
+	str_ = v.toString();
 }
 
 template <typename T>
@@ -53,18 +28,8 @@ Operand<T> &Operand<T>::operator=(IOperand const & rhs)
 	{
 		type_ = rhs.getType();
 		precision_ = rhs.getPrecision();
-		
-		std::string str = rhs.toString();
-		if (type_ == Int8)
-			value_ = static_cast<int8_t>(std::stoi(str));
-		else if (type_ == Int16)
-			value_ = static_cast<int16_t>(std::stoi(str));
-		else if (type_ == Int32)
-			value_ = std::stoi(str);
-		else if (type_ == Float)
-			value_ = std::stof(str);
-		else
-			value_ = std::stod(str);
+		value_ = nativeValue<T>(rhs);
+		str_ = rhs.toString();
 	}
 	return *this;
 }
@@ -79,168 +44,91 @@ template <typename T>
 std::string const & Operand<T>::toString(void) const {return str_;}
 
 template <typename T>
-IOperand const * Operand<T>::operator+(IOperand const & rhs) const
-{
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
+T Operand<T>::getValue(void) const {return value_;}
 
-	if (e < Float)
+// Reads the native value of any operand, converted to R, without going through its string
+template <typename R>
+R nativeValue(IOperand const & operand)
+{
+	switch (operand.getType())
 	{
-		value = std::to_string(static_cast<int64_t>(value_) + std::stoll(rhs.toString()));
-		return (OperandFactory::getInstance().createOperand(e, value));
+		case Int8:
+			return static_cast<R>(static_cast<Operand<int8_t> const &>(operand).getValue());
+		case Int16:
+			return static_cast<R>(static_cast<Operand<int16_t> const &>(operand).getValue());
+		case Int32:
+			return static_cast<R>(static_cast<Operand<int32_t> const &>(operand).getValue());
+		case Float:
+			return static_cast<R>(static_cast<Operand<float> const &>(operand).getValue());
+		case Double:
+			return static_cast<R>(static_cast<Operand<double> const &>(operand).getValue());
+		default:
+			throw InvalidTypeException("");
 	}
-	else
+}
+
+// Adapter from the IOperand API to the executor's value representation
+inline Value toValue(IOperand const & operand)
+{
+	switch (operand.getType())
 	{
-		value = std::to_string(static_cast<double>(value_) + std::stold(rhs.toString()));
-		return (OperandFactory::getInstance().createOperand(e, value));
+		case Int8:
+			return Value(nativeValue<int8_t>(operand));
+		case Int16:
+			return Value(nativeValue<int16_t>(operand));
+		case Int32:
+			return Value(nativeValue<int32_t>(operand));
+		case Float:
+			return Value(nativeValue<float>(operand));
+		default:
+			return Value(nativeValue<double>(operand));
 	}
 }
 
 template <typename T>
-IOperand const * Operand<T>::operator-(IOperand const & rhs) const
+IOperand const * Operand<T>::operator+(IOperand const & rhs) const
 {
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
+	return (OperandFactory().createOperand(toValue(*this) + toValue(rhs)));
+}
 
-	if (e < Float)
-	{
-		value = std::to_string(static_cast<int64_t>(value_) - std::stoll(rhs.toString()));
-		return (OperandFactory::getInstance().createOperand(e, value));
-	}
-	else
-	{
-		value = std::to_string(static_cast<double>(value_) - std::stold(rhs.toString()));
-		return (OperandFactory::getInstance().createOperand(e, value));
-	}
+template <typename T>
+IOperand const * Operand<T>::operator-(IOperand const & rhs) const
+{
+	return (OperandFactory().createOperand(toValue(*this) - toValue(rhs)));
 }
 
 template <typename T>
 IOperand const * Operand<T>::operator*(IOperand const & rhs) const
 {
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
-
-	if (e < Float)
-	{
-		value = std::to_string(static_cast<int64_t>(value_) * std::stoll(rhs.toString()));
-		return (OperandFactory::getInstance().createOperand(e, value));
-	}
-	else
-	{
-		value = std::to_string(static_cast<double>(value_) * std::stold(rhs.toString()));
-		return (OperandFactory::getInstance().createOperand(e, value));
-	}
+	return (OperandFactory().createOperand(toValue(*this) * toValue(rhs)));
 }
 
 template <typename T>
 IOperand const * Operand<T>::operator/(IOperand const & rhs) const
 {
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
-
-	if (e < Float)
-	{
-		long long divisor = std::stoll(rhs.toString());
-		if (divisor == 0)
-			throw DivModByZeroException();
-		value = std::to_string(static_cast<int64_t>(value_) / divisor);
-	}
-	else
-	{
-		long double divisor = std::stold(rhs.toString());
-		if (divisor == 0)
-			throw DivModByZeroException();
-		value = std::to_string(static_cast<double>(value_) / divisor);
-	}
-	return (OperandFactory::getInstance().createOperand(e, value));
-
+	return (OperandFactory().createOperand(toValue(*this) / toValue(rhs)));
 }
 
 template <typename T>
 IOperand const * Operand<T>::operator%(IOperand const & rhs) const
 {
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
-
-	if (e < Float)
-	{
-		long long divisor = std::stoll(rhs.toString());
-		if (divisor == 0)
-			throw DivModByZeroException();
-		value = std::to_string(static_cast<int64_t>(value_) % divisor);
-	}
-	else
-	{
-		long double divisor = std::stold(rhs.toString());
-		if (divisor == 0)
-			throw DivModByZeroException();
-		value = std::to_string(fmod(static_cast<long double>(value_), divisor));
-	}
-	return (OperandFactory::getInstance().createOperand(e, value));
+	return (OperandFactory().createOperand(toValue(*this) % toValue(rhs)));
 }
 
 template <typename T>
 bool	Operand<T>::operator==(IOperand const & rhs) const
 {
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
-
-	if (e < Float)
-		return (static_cast<int32_t>(value_) == std::stoi(rhs.toString()));
-	else if (e == Float)
-		return (static_cast<float>(value_) == std::stof(rhs.toString()));
-	else
-		return (static_cast<double>(value_) == std::stod(rhs.toString()));
+	return (toValue(*this) == toValue(rhs));
 }
 
 template <typename T>
 inline bool Operand<T>::operator<(IOperand const &rhs) const
 {
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
-
-	if (e < Float)
-		return (static_cast<int32_t>(value_) < std::stoi(rhs.toString()));
-	else if (e == Float)
-		return (static_cast<float>(value_) < std::stof(rhs.toString()));
-	else
-		return (static_cast<double>(value_) < std::stod(rhs.toString()));
+	return (toValue(*this) < toValue(rhs));
 }
 
 template <typename T>
 inline bool Operand<T>::operator>(IOperand const &rhs) const
 {
-	std::string value;
-	e_OperandType e = rhs.getType();
-
-	if (type_ >= e)
-		e = type_;
-
-	if (e < Float)
-		return (static_cast<int32_t>(value_) > std::stoi(rhs.toString()));
-	else if (e == Float)
-		return (static_cast<float>(value_) > std::stof(rhs.toString()));
-	else
-		return (static_cast<double>(value_) > std::stod(rhs.toString()));
+	return (toValue(*this) > toValue(rhs));
 }
@@ -1,28 +1,28 @@
 #pragma once
 
+#include <string_view>
 #include "IOperand.hpp"
+#include "Value.hpp"
 
 class OperandFactory
 {
 public:
-	static OperandFactory& getInstance();
+	OperandFactory(void);
+	~OperandFactory(void);
 
 	IOperand const	*createOperand(e_OperandType type, std::string const & value) const;
+	IOperand const	*createOperand(Value const & value) const;
+	Value			createValue(e_OperandType type, std::string_view literal) const;
 
 private:
 
 	OperandFactory	&operator=(OperandFactory const & rhs);
 	OperandFactory(OperandFactory const & rhs);
-	OperandFactory(void);
-	~OperandFactory(void);
-
-	bool	isValidValue(e_OperandType type, std::string str) const;
-
-	IOperand const	*createInt8(std::string const & value) const;
-	IOperand const	*createInt16(std::string const & value) const;
-	IOperand const	*createInt32(std::string const & value) const;
-	IOperand const	*createFloat(std::string const & value) const;
-	IOperand const	*createDouble(std::string const & value) const;
 
-	static OperandFactory * s_instance;
+	// Validate, convert and range-check a literal in one pass, with no allocation
+	// unless an error has to be reported
+	template <typename T>
+	Value	parseInteger(std::string_view literal) const;
+	template <typename T>
+	Value	parseFloating(std::string_view literal) const;
 };
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include "Value.hpp"
+
+// Contiguous structure-of-arrays stack: one byte of type tag and one packed
+// 8-byte payload per slot, bottom of the stack first
+class OperandStack
+{
+public:
+	OperandStack(void);
+	~OperandStack(void);
+
+	void	reserve(std::size_t capacity);
+	std::size_t	size(void) const;
+	bool	empty(void) const;
+
+	void	push(Value const & value);
+	void	pop(void);
+	Value	top(void) const;
+	void	setTop(Value const & value);
+	Value	at(std::size_t index) const;
+	void	swapTop(void);
+	void	sort(void);
+
+	// Unchecked access for opcodes whose operand types were proven at load time
+	Payload const &	payloadFromTop(std::size_t offset) const {return values_[size_ - 1 - offset];}
+
+	// Raw storage for native code, which tracks the depth itself: never reallocated
+	// unless reserve() or push() needs more than the current capacity
+	uint8_t	*typeData(void) {return types_.get();}
+	Payload	*valueData(void) {return values_.get();}
+	void	setSize(std::size_t size) {size_ = size;}
+
+private:
+	OperandStack(OperandStack const & rhs);
+	OperandStack	&operator=(OperandStack const & rhs);
+
+	std::unique_ptr<uint8_t[]>	types_;
+	std::unique_ptr<Payload[]>	values_;
+	std::size_t					size_;
+	std::size_t					capacity_;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Parser.hpp"
+
+// Load-time peephole pass (-O1): folds constant arithmetic, drops push/pop and
+// swap/swap pairs and asserts that are known to hold, without changing which
+// error is raised nor its line
+class Optimizer
+{
+public:
+	static void optimize(t_Program &program);
+
+private:
+	Optimizer(void);
+
+	static bool reduce(t_Program &out);
+	static bool fold(t_Program &out);
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "SpscRing.hpp"
+#include "Value.hpp"
+
+// When buffered output reaches the standard output: at every line, when the buffer is full,
+// or only once the program is over
+enum e_FlushPolicy {FlushLine, FlushFull, FlushExit};
+
+// Output of the executor: values are formatted straight into a reusable buffer with
+// std::to_chars, which is written with one write(2) per flush instead of one per line
+class OutputBuffer
+{
+public:
+	// Line flushing on a terminal, full buffering otherwise, as stdio does
+	explicit OutputBuffer(int fd);
+	~OutputBuffer(void);
+
+	int		fd(void) const {return fd_;}
+	void	setPolicy(e_FlushPolicy policy);
+	void	writeLine(Value const & value);
+	void	writeLine(char c);
+	void	write(const char *data, std::size_t size);
+	void	write(Value const & value, bool roundTrip);
+	void	newLine(void);
+	// Returns once everything written so far reached the file descriptor
+	void	flush(void);
+
+	// Hands full buffers to a writer thread instead of writing them: a slow reader of the
+	// standard output then only delays flush(), never the instructions writing the output
+	void	startWriter(void);
+
+	// Held output is kept in memory whatever the policy, until release() writes or drops it
+	void	hold(void);
+	void	release(bool write);
+	// Appends the held output to out instead of writing it
+	void	release(std::string &out);
+
+private:
+	OutputBuffer(OutputBuffer const & rhs);
+	OutputBuffer	&operator=(OutputBuffer const & rhs);
+
+	// A buffer on its way to the writer thread, or back once written; no data ends the thread
+	typedef struct s_Chunk
+	{
+		std::unique_ptr<char[]>	data;
+		std::size_t				size;
+		std::size_t				capacity;
+
+	}	t_Chunk;
+
+	typedef SpscRing<t_Chunk, 64>	t_ChunkRing;
+
+	char	*reserve(std::size_t size);
+	void	endLine(char *end);
+	void	handOff(void);
+	void	takeSpare(void);
+	void	writerLoop(void);
+	void	waitForChunk(void);
+	void	wakeWriter(void);
+
+	void	writeAll(const char *data, std::size_t size) const;
+
+	static const std::size_t	s_capacity = 1 << 16;
+
+	int						fd_;
+	std::unique_ptr<char[]>	data_;
+	std::size_t				size_;
+	std::size_t				capacity_;
+	e_FlushPolicy			policy_;
+	bool					held_;
+
+	std::unique_ptr<t_ChunkRing>	written_;	// to the writer thread
+	std::unique_ptr<t_ChunkRing>	spare_;		// emptied, back to the executor
+	std::thread						writer_;
+	std::size_t						submitted_;
+	std::atomic<std::size_t>		completed_;
+	// An idle writer sleeps instead of polling: the program may print nothing for a long time
+	std::mutex						idleLock_;
+	std::condition_variable			idle_;
+	std::atomic<bool>				sleeping_;
+};
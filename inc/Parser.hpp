@@ -1,37 +1,83 @@
 #pragma once
 
 #include "Operand.hpp"
+#include "OperandFactory.hpp"
 #include "Lexer.hpp"
 #include <list>
+#include <vector>
 
-enum e_Operation {PUSH, ASSERT, POP, SWAP, DUMP, ADD, SUB, MUL, DIV, MOD, PRINT, EXIT, SORT, NONE};
+enum e_Operation : uint8_t {PUSH, ASSERT, POP, SWAP, DUMP, ADD, SUB, MUL, DIV, MOD, PRINT, EXIT, SORT, NONE,
+	// Specialized forms chosen by StackAnalyzer, never produced by the parser nor stored in bytecode
+	POP_U, SWAP_U, ASSERT_U, PRINT_I8, ADD_T, SUB_T, MUL_T, DIV_T, MOD_T,
+	// Superinstructions chosen by InstructionFuser, same restrictions
+	PUSH_ADD, PUSH_SUB, PUSH_MUL, PUSH_DIV, PUSH_MOD, SWAP_SUB};
 
+// 16-byte instruction: push/assert literals are stored inline, tagged by operandType.
+// variant selects the operand types of a typed arithmetic opcode (lhs * 5 + rhs)
 typedef struct s_ParsedInstr
 {
 	e_Operation		instruction;
 	e_OperandType	operandType;
-	const IOperand	*operand;
-	std::size_t	line;
+	uint8_t			variant;
+	uint32_t		line;
+	Payload			operand;
 
 }	t_ParsedInstr;
 
+typedef std::vector<t_ParsedInstr>	t_Program;
+
+// Number of stack values an instruction needs before it can run
+inline std::size_t requiredDepth(e_Operation op)
+{
+	switch (op)
+	{
+		case ASSERT: case POP: case PRINT:
+			return 1;
+		case SWAP: case ADD: case SUB: case MUL: case DIV: case MOD:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+// Opcode an instruction had before StackAnalyzer specialized it
+inline e_Operation genericOperation(e_Operation op)
+{
+	switch (op)
+	{
+		case POP_U:		return POP;
+		case SWAP_U:	return SWAP;
+		case ASSERT_U:	return ASSERT;
+		case PRINT_I8:	return PRINT;
+		case ADD_T: case SUB_T: case MUL_T: case DIV_T: case MOD_T:
+			return static_cast<e_Operation>(op - ADD_T + ADD);
+		default:
+			return op;
+	}
+}
+
 class Parser
 {
 public:
-	static Parser& getInstance();
+	Parser(Lexer const & lexer, OperandFactory const & factory);
+	~Parser(void);
 
-	std::list<t_ParsedInstr> parse(std::list<t_LexToken> &lexTokens) const;
-	static void cleanTokens(const std::list<t_ParsedInstr>& tokens);
+	t_Program parse(std::string_view source) const;
+	t_Program parse(std::string_view source, std::size_t threads) const;
+	t_Program parse(std::list<t_LexToken> &lexTokens) const;
+	t_Program parse(std::vector<t_LexToken> const & lexTokens) const;
+	bool parseNext(std::string_view &source, std::size_t &line_number, t_ParsedInstr &instr) const;
 
 private:
 
 	Parser	&operator=(Parser const & rhs);
 	Parser(Parser const & rhs);
-	Parser(void);
-	~Parser(void);
 
-	e_Operation toOperation(const std::string& opStr) const;
-	e_OperandType toType(const std::string& type) const;
+	t_Program parseLines(std::string_view source, std::size_t &line_number) const;
+	t_ParsedInstr parseToken(t_LexToken const & lexToken) const;
+	e_Operation toOperation(std::string_view opStr) const;
+	e_OperandType toType(std::string_view type) const;
 
-	static Parser * s_instance;
+	Lexer const &			lexer_;
+	OperandFactory const &	factory_;
 };
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string_view>
+#include "Vm.hpp"
+
+// Runs the lexer, the parser and the executor on three threads connected by rings of
+// batches, so execution starts while the rest of the program is still being read.
+// Parsing errors still prevent any execution: the program's output is held back until
+// the whole source is parsed, then either written out or replaced by the parsing errors
+class Pipeline
+{
+public:
+	// Returns false when the program reported an error
+	static bool run(Vm &vm, std::string_view source);
+
+private:
+	Pipeline(void);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <istream>
+#include <string>
+#include <string_view>
+
+// Whole program text in one contiguous block, so lexer tokens can point into it:
+// a file is mapped in memory, the standard input is read up to its ";;" line, and a
+// program received whole is taken over as it is
+class SourceBuffer
+{
+public:
+	SourceBuffer(void);
+	~SourceBuffer(void);
+
+	bool				map(const char *path);
+	void				read(std::istream &input);
+	void				assign(std::string &&text);
+	std::string_view	view(void) const;
+
+private:
+	SourceBuffer(SourceBuffer const & rhs);
+	SourceBuffer	&operator=(SourceBuffer const & rhs);
+
+	void	release(void);
+
+	const char	*data_;
+	std::size_t	size_;
+	bool		mapped_;
+	std::string	storage_;
+};
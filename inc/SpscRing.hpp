@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+// Lock-free ring between exactly one producer thread and one consumer thread.
+// Each side only writes its own index, so a slot is handed over with one release store;
+// a full or empty ring makes the waiting side yield, then sleep, instead of blocking on a lock
+template <typename T, std::size_t Capacity>
+class SpscRing
+{
+	static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of two");
+
+public:
+	SpscRing(void) : head_(0), tail_(0) {}
+	~SpscRing(void) {}
+
+	void push(T &&value)
+	{
+		for (unsigned int spins = 0; !tryPush(value); ++spins)
+			wait(spins);
+	}
+
+	T pop(void)
+	{
+		T value;
+
+		for (unsigned int spins = 0; !tryPop(value); ++spins)
+			wait(spins);
+		return value;
+	}
+
+	// Moves value into the ring unless it is full
+	bool tryPush(T &value)
+	{
+		std::size_t tail = tail_.load(std::memory_order_relaxed);
+
+		if (tail - head_.load(std::memory_order_acquire) == Capacity)
+			return false;
+		slots_[tail & (Capacity - 1)] = std::move(value);
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T &value)
+	{
+		std::size_t head = head_.load(std::memory_order_relaxed);
+
+		if (tail_.load(std::memory_order_acquire) == head)
+			return false;
+		value = std::move(slots_[head & (Capacity - 1)]);
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only meaningful on the consumer side, where the ring can't become empty behind its back
+	bool empty(void) const
+	{
+		return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_relaxed);
+	}
+
+	// Short waits stay on the core, long ones (an idle stage) give it back
+	static void wait(unsigned int spins)
+	{
+		if (spins < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+
+private:
+	SpscRing(SpscRing const & rhs);
+	SpscRing	&operator=(SpscRing const & rhs);
+
+	// Kept on separate cache lines so the two threads don't invalidate each other's index
+	alignas(64) std::atomic<std::size_t>	head_;	// next slot to read, written by the consumer
+	alignas(64) std::atomic<std::size_t>	tail_;	// next slot to write, written by the producer
+	alignas(64) std::array<T, Capacity>		slots_;
+};
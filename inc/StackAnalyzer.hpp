@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Parser.hpp"
+
+// Programs have no jumps, so the depth of the stack before each instruction is
+// known at load time, and so is the type of every slot until a sort mixes them.
+// The analysis rewrites instructions into forms that skip the matching run-time
+// checks and reports stack errors that are certain to be the program's first effect
+class StackAnalyzer
+{
+public:
+	// Returns the deepest stack the program can reach
+	static std::size_t analyze(t_Program &program);
+
+private:
+	StackAnalyzer(void);
+
+	static void reportUnderflow(t_ParsedInstr const & instr);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs tasks 0 to count - 1 on a fixed set of threads. Each thread owns a deque of task
+// indices, dealt round-robin so tasks complete roughly in order; a thread whose deque is
+// empty steals from the back of another one, so a few long tasks never leave threads idle
+class TaskPool
+{
+public:
+	typedef std::function<void(std::size_t)>	t_Task;
+
+	TaskPool(std::size_t threads, std::size_t count, t_Task const & task);
+	// Returns once every task has run
+	~TaskPool(void);
+
+private:
+	TaskPool(TaskPool const & rhs);
+	TaskPool	&operator=(TaskPool const & rhs);
+
+	// Owned by one thread, which takes from the front; thieves take from the back
+	typedef struct alignas(64) s_Queue
+	{
+		std::mutex				lock;
+		std::deque<std::size_t>	tasks;
+
+	}	t_Queue;
+
+	bool	next(std::size_t self, std::size_t &task);
+	void	work(std::size_t self);
+
+	t_Task						task_;
+	std::size_t					threadCount_;
+	std::unique_ptr<t_Queue[]>	queues_;
+	std::vector<std::thread>	threads_;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include "IOperand.hpp"
+
+// Native storage shared by Value and the executor's packed value array
+union Payload
+{
+	int8_t	i8;
+	int16_t	i16;
+	int32_t	i32;
+	float	f;
+	double	d;
+};
+
+// Compact tagged value (16 bytes): what the executor stack holds, with no heap behind it
+class Value
+{
+public:
+	Value(void);
+	Value(int8_t value);
+	Value(int16_t value);
+	Value(int32_t value);
+	Value(float value);
+	Value(double value);
+	Value(e_OperandType type, Payload payload);
+
+	Value operator+(Value const & rhs) const; // Sum
+	Value operator-(Value const & rhs) const; // Difference
+	Value operator*(Value const & rhs) const; // Product
+	Value operator/(Value const & rhs) const; // Quotient
+	Value operator%(Value const & rhs) const; // Modulo
+
+	bool operator==(Value const & rhs) const;
+	bool operator<(Value const & rhs) const;
+	bool operator>(Value const & rhs) const;
+
+	e_OperandType getType(void) const;
+	Payload getPayload(void) const;
+	int getPrecision(void) const;
+	std::string toString(void) const;
+	// Writes the value at first without allocating, returns the end of the text. roundTrip
+	// writes floats with the fewest digits that read back to the same value instead
+	char *format(char *first, bool roundTrip = false) const;
+
+	static const std::size_t	maxFormattedSize = 32;
+
+	template <typename R>
+	R as(void) const;
+
+	template <typename R, typename V>
+	static Value narrow(V value);
+
+private:
+	static void outOfRange(int64_t value, e_OperandType type);
+	static void outOfRange(long double value, e_OperandType type);
+
+	e_OperandType	type_;
+	Payload			payload_;
+};
+
+template <typename R>
+R Value::as(void) const
+{
+	switch (type_)
+	{
+		case Int8:
+			return static_cast<R>(payload_.i8);
+		case Int16:
+			return static_cast<R>(payload_.i16);
+		case Int32:
+			return static_cast<R>(payload_.i32);
+		case Float:
+			return static_cast<R>(payload_.f);
+		default:
+			return static_cast<R>(payload_.d);
+	}
+}
+
+// Range-checks a result computed in a wider type (int64_t or long double) and narrows it to R
+template <typename R, typename V>
+Value Value::narrow(V value)
+{
+	if (value > std::numeric_limits<R>::max() || value < std::numeric_limits<R>::lowest())
+		outOfRange(value, Value(R()).getType());
+	return Value(static_cast<R>(value));
+}
+
+// Compile-time view of each operand type, used by the typed opcodes
+template <typename T> struct OperandTraits;
+
+template <> struct OperandTraits<int8_t>
+{
+	static const e_OperandType type = Int8;
+	static int8_t get(Payload const & payload) {return payload.i8;}
+};
+
+template <> struct OperandTraits<int16_t>
+{
+	static const e_OperandType type = Int16;
+	static int16_t get(Payload const & payload) {return payload.i16;}
+};
+
+template <> struct OperandTraits<int32_t>
+{
+	static const e_OperandType type = Int32;
+	static int32_t get(Payload const & payload) {return payload.i32;}
+};
+
+template <> struct OperandTraits<float>
+{
+	static const e_OperandType type = Float;
+	static float get(Payload const & payload) {return payload.f;}
+};
+
+template <> struct OperandTraits<double>
+{
+	static const e_OperandType type = Double;
+	static double get(Payload const & payload) {return payload.d;}
+};
+
+// Result type of an operation between L and R: the most precise of both
+template <typename L, typename R>
+using PromotedType = typename std::conditional<(OperandTraits<L>::type >= OperandTraits<R>::type), L, R>::type;
+
+// Native type of an e_OperandType known at compile time
+template <std::size_t Type>
+using NativeType = typename std::tuple_element<Type, std::tuple<int8_t, int16_t, int32_t, float, double> >::type;
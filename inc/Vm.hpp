@@ -0,0 +1,71 @@
+#pragma once
+
+#include <iostream>
+#include <list>
+#include <string_view>
+#include <unistd.h>
+#include "CommandsExecutor.hpp"
+#include "Exceptions.hpp"
+#include "Lexer.hpp"
+#include "OperandFactory.hpp"
+#include "Parser.hpp"
+
+// One virtual machine: its own lexer, parser, stack, output and error list, so several
+// programs can run side by side in one process. A Vm is used by one thread at a time,
+// inside a Scope. Errors of the program go to errors, avm's own messages (files that
+// can't be written, bytecode that can't be loaded...) to messages
+class Vm
+{
+public:
+	Vm(int output = STDOUT_FILENO, std::ostream &errors = std::cerr, std::ostream &messages = std::cout);
+	~Vm(void);
+
+	// Errors raised on this thread go to the Vm's list while a Scope lives
+	class Scope
+	{
+	public:
+		explicit Scope(Vm &vm);
+		~Scope(void);
+
+	private:
+		Scope(Scope const & rhs);
+		Scope	&operator=(Scope const & rhs);
+
+		std::list<Error>	*previous_;
+	};
+
+	Lexer const &			lexer(void) const {return lexer_;}
+	Parser const &			parser(void) const {return parser_;}
+	CommandsExecutor &		executor(void) {return executor_;}
+	OperandStack const &	stack(void) const {return executor_.stack();}
+	std::ostream &			errorStream(void) const {return errorStream_;}
+	std::ostream &			messageStream(void) const {return messageStream_;}
+
+	bool	isError(void) const {return !errors_.empty();}
+	void	printErrors(void);
+
+	// Every call below returns false once it has reported what went wrong
+
+	// Parses a source program on up to parseThreads threads, or loads it when it is
+	// bytecode, name standing for its file in messages
+	bool	load(std::string_view source, const char *name, t_Program &program, std::size_t parseThreads = 1);
+	// Makes room for values on the stack ahead of the run
+	bool	reserveStack(std::size_t values);
+	// Optimizes the program first with optimize, runs it as native code with jit
+	bool	run(t_Program &program, bool optimize, bool jit, std::size_t stackReserve = 0);
+	// Writes the program, optimized with optimize, as bytecode or as C++ to path
+	bool	compile(t_Program &program, bool optimize, const char *path);
+	bool	emitCpp(t_Program &program, bool optimize, const char *name, const char *path);
+
+private:
+	Vm(Vm const & rhs);
+	Vm	&operator=(Vm const & rhs);
+
+	OperandFactory		factory_;
+	Lexer				lexer_;
+	Parser				parser_;
+	std::ostream		&errorStream_;
+	std::ostream		&messageStream_;
+	CommandsExecutor	executor_;
+	std::list<Error>	errors_;
+};
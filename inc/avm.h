@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+** Embedding API of libavm, usable from C and C++. A machine runs one program per load:
+**   t_Avm *avm = avm_create(AVM_OPTIMIZE);
+**   if (avm_load(avm, text, size) == 0 && avm_run(avm) == 0)
+**       ... avm_output(), avm_stack_size(), avm_stack_value() ...
+**   else
+**       ... avm_errors() ...
+**   avm_destroy(avm);
+** Separate machines run on separate threads freely; one machine is used by one thread
+** at a time, but not necessarily always the same one.
+*/
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct s_Avm	t_Avm;
+
+typedef enum e_AvmType {AVM_INT8, AVM_INT16, AVM_INT32, AVM_FLOAT, AVM_DOUBLE}	t_AvmType;
+
+// Every operand type converts exactly to a double
+typedef struct s_AvmValue
+{
+	t_AvmType	type;
+	double		value;
+
+}	t_AvmValue;
+
+// Flags of avm_create(), as the -O1, --jit and --dump-format options
+enum {AVM_OPTIMIZE = 1, AVM_JIT = 2, AVM_DUMP_JSON = 4, AVM_DUMP_BINARY = 8};
+
+// NULL when out of memory
+t_Avm		*avm_create(int flags);
+void		avm_destroy(t_Avm *avm);
+
+// Parses a source program, or loads compiled bytecode, on a fresh machine: the stack,
+// output and errors of the previous program are dropped. 0 on success, -1 on errors
+int			avm_load(t_Avm *avm, const char *program, size_t size);
+// Runs the loaded program once. 0 when it ended with exit, -1 on errors
+int			avm_run(t_Avm *avm);
+
+// What the program printed; binary dumps hold NUL bytes, so size gives its length
+const char	*avm_output(t_Avm const *avm, size_t *size);
+// Error messages as avm prints them, one per line, "" when there is none
+const char	*avm_errors(t_Avm const *avm);
+// Stack left by the program, index 0 being its top. 0 on success, -1 past its bottom
+size_t		avm_stack_size(t_Avm const *avm);
+int			avm_stack_value(t_Avm const *avm, size_t index, t_AvmValue *value);
+
+#ifdef __cplusplus
+}
+#endif
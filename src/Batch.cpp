@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include "Batch.hpp"
+#include "TaskPool.hpp"
+
+void Batch::runProgram(const char *file, t_Runner const & runner, t_Result &result)
+{
+	std::ostringstream	out;
+	std::ostringstream	errors;
+	Vm					vm(STDOUT_FILENO, errors, out);
+	Vm::Scope			scope(vm);
+
+	vm.executor().output().hold();
+	result.status = runner(vm, file, out);
+	result.output = out.str();
+	vm.executor().output().release(result.output);
+	result.errors = errors.str();
+}
+
+// Each result is written as soon as it and every result before it are complete,
+// so memory only holds the programs that finished ahead of their turn
+int Batch::run(std::vector<std::string> const & files, std::size_t jobs, t_Runner const & runner)
+{
+	std::vector<t_Result>	results(files.size());
+	std::mutex				lock;
+	std::condition_variable	completed;
+	int						status = 0;
+
+	TaskPool pool(std::min(jobs, files.size()), files.size(), [&](std::size_t i)
+	{
+		t_Result result;
+
+		runProgram(files[i].c_str(), runner, result);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			results[i] = std::move(result);
+			results[i].done = true;
+		}
+		completed.notify_one();
+	});
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		t_Result result;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			completed.wait(guard, [&results, i] {return results[i].done;});
+			result = std::move(results[i]);
+		}
+		std::cout.write(result.output.data(), result.output.size()).flush();
+		std::cerr << result.errors << std::flush;
+		if (result.status != 0)
+			status = 1;
+	}
+	return status;
+}
+
+bool Batch::readManifest(const char *path, std::vector<std::string> &files)
+{
+	std::ifstream	file;
+	std::istream	*input = &std::cin;
+
+	if (std::string(path) != "-")
+	{
+		file.open(path);
+		if (!file)
+			return false;
+		input = &file;
+	}
+	for (std::string line; std::getline(*input, line);)
+		if (!line.empty())
+			files.push_back(line);
+	return true;
+}
@@ -0,0 +1,132 @@
+#include <cstring>
+#include <fstream>
+#include "Bytecode.hpp"
+
+typedef struct s_BytecodeHeader
+{
+	char		magic[4];
+	uint16_t	version;
+	uint16_t	instrSize;
+	uint32_t	byteOrder;
+	uint32_t	reserved;
+	uint64_t	count;
+	uint64_t	checksum;
+
+}	t_BytecodeHeader;
+
+static_assert(sizeof(t_BytecodeHeader) == 32, "bytecode header must stay packed on 32 bytes");
+
+static const char		s_magic[4] = {'A', 'V', 'M', 'C'};
+static const uint32_t	s_byteOrder = 0x01020304;
+
+static uint64_t checksum(const unsigned char *data, std::size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+bool Bytecode::isBytecode(std::string_view data)
+{
+	return (data.size() >= sizeof(s_magic) && std::memcmp(data.data(), s_magic, sizeof(s_magic)) == 0);
+}
+
+bool Bytecode::write(t_Program const & program, const char *path, std::string &error)
+{
+	std::vector<t_ParsedInstr>	body(program.size());
+
+	// Rebuild every record on zeroed memory so padding bytes are deterministic
+	std::memset(static_cast<void *>(body.data()), 0, body.size() * sizeof(t_ParsedInstr));
+	for (std::size_t i = 0; i < program.size(); ++i)
+	{
+		body[i].instruction = program[i].instruction;
+		body[i].operandType = program[i].operandType;
+		body[i].line = program[i].line;
+		body[i].operand = program[i].operand;
+	}
+
+	t_BytecodeHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, s_magic, sizeof(s_magic));
+	header.version = version;
+	header.instrSize = sizeof(t_ParsedInstr);
+	header.byteOrder = s_byteOrder;
+	header.count = body.size();
+	header.checksum = checksum(reinterpret_cast<const unsigned char *>(body.data()), body.size() * sizeof(t_ParsedInstr));
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		error = std::string("could not create file ") + path;
+		return false;
+	}
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(body.data()), body.size() * sizeof(t_ParsedInstr));
+	if (!file.good())
+	{
+		error = std::string("could not write file ") + path;
+		return false;
+	}
+	return true;
+}
+
+static bool checkHeader(t_BytecodeHeader const & header, std::size_t fileSize, std::string &error)
+{
+	if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0)
+		error = "not an avm bytecode file";
+	else if (header.byteOrder != s_byteOrder)
+		error = "bytecode was compiled for another byte order";
+	else if (header.version != Bytecode::version || header.instrSize != sizeof(t_ParsedInstr))
+		error = "unsupported bytecode version " + std::to_string(header.version);
+	else if (header.count != (fileSize - sizeof(header)) / sizeof(t_ParsedInstr)
+		|| (fileSize - sizeof(header)) % sizeof(t_ParsedInstr) != 0)
+		error = "truncated bytecode file";
+	else
+		return true;
+	return false;
+}
+
+// Specialized opcodes skip stack checks, so they must never come from a file
+static bool checkInstructions(t_Program const & program)
+{
+	for (t_ParsedInstr const & instr : program)
+	{
+		if (instr.instruction > NONE || instr.variant != 0 || instr.operandType > NoType)
+			return false;
+		if (instr.instruction <= ASSERT && instr.operandType == NoType)
+			return false;
+	}
+	return true;
+}
+
+// Copies the instruction array out of the mapped file: nothing is parsed
+bool Bytecode::load(std::string_view bytes, const char *name, t_Program &program, std::string &error)
+{
+	const unsigned char	*data = reinterpret_cast<const unsigned char *>(bytes.data());
+	t_BytecodeHeader	header;
+
+	if (bytes.size() < sizeof(t_BytecodeHeader))
+	{
+		error = std::string(name) + ": truncated bytecode file";
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (!checkHeader(header, bytes.size(), error))
+		error = std::string(name) + ": " + error;
+	else if (checksum(data + sizeof(header), header.count * sizeof(t_ParsedInstr)) != header.checksum)
+		error = std::string(name) + ": bytecode checksum mismatch";
+	else
+	{
+		program.resize(header.count);
+		std::memcpy(static_cast<void *>(program.data()), data + sizeof(header), header.count * sizeof(t_ParsedInstr));
+		if (checkInstructions(program))
+			return true;
+		error = std::string(name) + ": invalid instruction in bytecode";
+	}
+	return false;
+}
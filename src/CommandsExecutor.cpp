@@ -1,194 +1,184 @@
 #include "CommandsExecutor.hpp"
 #include "Exceptions.hpp"
-#include <map>
-
-CommandsExecutor& CommandsExecutor::getInstance()
-{
-	static CommandsExecutor instance;
-	return instance;
-}
+#include "Jit.hpp"
+#include <cmath>
+#include <cstring>
 
 CommandsExecutor &CommandsExecutor::operator=(CommandsExecutor const & rhs) {(void)rhs; return *this;}
 
-CommandsExecutor::CommandsExecutor(CommandsExecutor const & rhs) {(void)rhs;}
+CommandsExecutor::CommandsExecutor(CommandsExecutor const & rhs)
+	: output_(rhs.output_.fd()), errors_(rhs.errors_), dumpFormat_(rhs.dumpFormat_), exit_(false) {}
 
-CommandsExecutor::CommandsExecutor(void) : exit_(false), right_(nullptr), left_(nullptr) {}
+CommandsExecutor::CommandsExecutor(int output, std::ostream &errors)
+	: output_(output), errors_(&errors), dumpFormat_(DumpText), exit_(false) {}
 
-CommandsExecutor::~CommandsExecutor(void)
+CommandsExecutor::~CommandsExecutor(void) {}
+
+void CommandsExecutor::reserve(std::size_t capacity)
 {
-	for (const IOperand * operand : stack_)
-	{
-		if (operand != nullptr)
-			delete operand;
-	}
-	if (left_ != nullptr)
-	{
-		delete left_;
-		left_ = nullptr;
-	}
-	if (right_ != nullptr)
-	{
-		delete right_;
-		right_ = nullptr;
-	}
+	stack_.reserve(capacity);
 }
 
-void CommandsExecutor::push(const IOperand *operand)
+void CommandsExecutor::push(Value const & operand)
 {
-	stack_.push_back(operand);
+	stack_.push(operand);
 }
 
-void CommandsExecutor::assert(const IOperand *operand)
+void CommandsExecutor::assert(Value const & operand)
 {
 	if (stack_.empty())
-	{
-		delete operand;
 		throw EmtpyStackException();
-	}
-	const IOperand * top = stack_.back();
-	if (!(*top == *operand))
-	{
-		delete operand;
+	if (!(stack_.top() == operand))
 		throw FalseAssertException();
-	}
-	delete operand;
 }
 
 void CommandsExecutor::pop()
 {
 	if (stack_.empty())
 		throw EmtpyStackException();
-	const IOperand * del = stack_.back();
-	stack_.pop_back();
-	delete del;
-	del = nullptr;
+	stack_.pop();
 }
 
 void CommandsExecutor::swap()
 {
 	if (stack_.size() < 2)
 		throw ImpossibleInstructionException("swap");
-	right_ = stack_.back();
-	stack_.pop_back();
-	left_ = stack_.back();
-	stack_.pop_back();
-	stack_.push_back(right_);
-	stack_.push_back(left_);
-	left_ = nullptr;
-	right_ = nullptr;
+	stack_.swapTop();
 }
 
 void CommandsExecutor::dump()
 {
-	for (auto it = stack_.rbegin(); it != stack_.rend(); ++it)
+	if (dumpFormat_ == DumpJson)
+		return dumpJson();
+	if (dumpFormat_ == DumpBinary)
+		return dumpBinary();
+	for (std::size_t i = stack_.size(); i > 0; --i)
+		output_.writeLine(stack_.at(i - 1));
+}
+
+// One array per dump on its own line, top of the stack first as in the text dump.
+// Floats are written with the fewest digits that read back to the same value,
+// infinities and NaN, which JSON numbers can't hold, as strings
+void CommandsExecutor::dumpJson()
+{
+	static const std::string_view prefixes[] = {"{\"type\":\"int8\",\"value\":", "{\"type\":\"int16\",\"value\":",
+		"{\"type\":\"int32\",\"value\":", "{\"type\":\"float\",\"value\":", "{\"type\":\"double\",\"value\":"};
+
+	output_.write("[", 1);
+	for (std::size_t i = stack_.size(); i > 0; --i)
+	{
+		Value value = stack_.at(i - 1);
+		bool finite = value.getType() < Float || std::isfinite(value.as<double>());
+
+		if (i != stack_.size())
+			output_.write(",", 1);
+		output_.write(prefixes[value.getType()].data(), prefixes[value.getType()].size());
+		if (!finite)
+			output_.write("\"", 1);
+		output_.write(value, true);
+		output_.write(finite ? "}" : "\"}", finite ? 1 : 2);
+	}
+	output_.write("]", 1);
+	output_.newLine();
+}
+
+// Little-endian, straight from the stack storage, bottom of the stack first: the number of
+// values on 8 bytes, one type byte per value (e_OperandType), then one 8-byte payload per
+// value holding the int8, int16, int32 or float in its low bytes and zeros above, or the double
+void CommandsExecutor::dumpBinary()
+{
+	uint64_t		count = stack_.size();
+	unsigned char	header[8];
+
+	for (int i = 0; i < 8; ++i)
+		header[i] = static_cast<unsigned char>(count >> (8 * i));
+	output_.write(reinterpret_cast<const char *>(header), sizeof(header));
+	output_.write(reinterpret_cast<const char *>(stack_.typeData()), count);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	output_.write(reinterpret_cast<const char *>(stack_.valueData()), count * sizeof(Payload));
+#else
+	for (std::size_t i = 0; i < count; ++i)
 	{
-		const IOperand* operand = *it;
-		if (operand != nullptr)
-			std::cout << operand->toString() << std::endl;
+		Payload const &	payload = stack_.valueData()[i];
+		uint64_t		bits = 0;
+		unsigned char	bytes[sizeof(Payload)];
+
+		switch (stack_.typeData()[i])
+		{
+			case Int8:	bits = static_cast<uint8_t>(payload.i8);	break;
+			case Int16:	bits = static_cast<uint16_t>(payload.i16);	break;
+			case Int32:	bits = static_cast<uint32_t>(payload.i32);	break;
+			case Float:	{uint32_t f; std::memcpy(&f, &payload.f, sizeof(f)); bits = f;}	break;
+			default:	std::memcpy(&bits, &payload.d, sizeof(bits));	break;
+		}
+		for (std::size_t b = 0; b < sizeof(bytes); ++b)
+			bytes[b] = static_cast<unsigned char>(bits >> (8 * b));
+		output_.write(reinterpret_cast<const char *>(bytes), sizeof(bytes));
 	}
+#endif
 }
 
 void CommandsExecutor::add()
 {
 	if (stack_.size() < 2)
 		throw ImpossibleInstructionException("add");
-	right_ = stack_.back();
-	stack_.pop_back();
-	left_ = stack_.back();
-	stack_.pop_back();
-	const IOperand * result = *left_ + *right_;
-	stack_.push_back(result);
-	delete left_;
-	left_ = nullptr;
-	delete right_;
-	right_ = nullptr;
+	Value right = stack_.top();
+	stack_.pop();
+	stack_.setTop(stack_.top() + right);
 }
 
 void CommandsExecutor::sub()
 {
 	if (stack_.size() < 2)
 		throw ImpossibleInstructionException("sub");
-	right_ = stack_.back();
-	stack_.pop_back();
-	left_ = stack_.back();
-	stack_.pop_back();
-	const IOperand * result = *left_ - *right_;
-	stack_.push_back(result);
-	delete left_;
-	left_ = nullptr;
-	delete right_;
-	right_ = nullptr;
+	Value right = stack_.top();
+	stack_.pop();
+	stack_.setTop(stack_.top() - right);
 }
 
 void CommandsExecutor::mul()
 {
 	if (stack_.size() < 2)
 		throw ImpossibleInstructionException("mul");
-	right_ = stack_.back();
-	stack_.pop_back();
-	left_ = stack_.back();
-	stack_.pop_back();
-	const IOperand * result = *left_ * *right_;
-	stack_.push_back(result);
-	delete left_;
-	left_ = nullptr;
-	delete right_;
-	right_ = nullptr;
+	Value right = stack_.top();
+	stack_.pop();
+	stack_.setTop(stack_.top() * right);
 }
 
 void CommandsExecutor::div()
 {
 	if (stack_.size() < 2)
 		throw ImpossibleInstructionException("div");
-	right_ = stack_.back();
-	stack_.pop_back();
-	left_ = stack_.back();
-	stack_.pop_back();
-	const IOperand * result = *left_ / *right_;
-	stack_.push_back(result);
-	delete left_;
-	left_ = nullptr;
-	delete right_;
-	right_ = nullptr;
+	Value right = stack_.top();
+	stack_.pop();
+	stack_.setTop(stack_.top() / right);
 }
 
 void CommandsExecutor::mod()
 {
 	if (stack_.size() < 2)
 		throw ImpossibleInstructionException("mod");
-	right_ = stack_.back();
-	stack_.pop_back();
-	left_ = stack_.back();
-	stack_.pop_back();
-	const IOperand * result = *left_ % *right_;
-	stack_.push_back(result);
-	delete left_;
-	left_ = nullptr;
-	delete right_;
-	right_ = nullptr;
+	Value right = stack_.top();
+	stack_.pop();
+	stack_.setTop(stack_.top() % right);
 }
 
 void CommandsExecutor::print()
 {
 	if (stack_.empty())
 		throw EmtpyStackException();
-	const IOperand * operand = stack_.back();
-	if (operand->getType() != Int8)
+	Value operand = stack_.top();
+	if (operand.getType() != Int8)
 		throw InvalidPrintException("not an int8");
-	int8_t number = static_cast<int8_t>(std::stoi(operand->toString()));
+	int8_t number = operand.as<int8_t>();
 	if (!isprint(number))
-		throw InvalidPrintException(operand->toString() + " is not printable");
-	std::cout << number << std::endl;
-}
-
-static bool compareForStack(const IOperand* a, const IOperand* b)
-{
-	return *a < *b;
+		throw InvalidPrintException(operand.toString() + " is not printable");
+	output_.writeLine(static_cast<char>(number));
 }
 
 void CommandsExecutor::sort()
 {
-	stack_.sort(compareForStack);
+	stack_.sort();
 }
 
 void CommandsExecutor::exit()
@@ -196,53 +186,193 @@ void CommandsExecutor::exit()
 	exit_ = true;
 }
 
-void CommandsExecutor::execute(std::list<t_ParsedInstr> &instructions)
-{
-	static const std::map<e_Operation, void (CommandsExecutor::*)()> noArgOps = {
-		{POP, &CommandsExecutor::pop},
-		{SWAP, &CommandsExecutor::swap},
-		{DUMP, &CommandsExecutor::dump},
-		{ADD, &CommandsExecutor::add},
-		{SUB, &CommandsExecutor::sub},
-		{MUL, &CommandsExecutor::mul},
-		{DIV, &CommandsExecutor::div},
-		{MOD, &CommandsExecutor::mod},
-		{PRINT,&CommandsExecutor::print},
-		{SORT,&CommandsExecutor::sort},
-		{EXIT, &CommandsExecutor::exit}
-	};
-	static const std::map<e_Operation, void (CommandsExecutor::*)(const IOperand *operand)> argOps = {
-		{PUSH, &CommandsExecutor::push},
-		{ASSERT, &CommandsExecutor::assert}
-	};
+void CommandsExecutor::assertUnchecked(Value const & operand)
+{
+	if (!(stack_.top() == operand))
+		throw FalseAssertException();
+}
+
+void CommandsExecutor::printInt8()
+{
+	int8_t number = stack_.payloadFromTop(0).i8;
+	if (!isprint(number))
+		throw InvalidPrintException(std::to_string(number) + " is not printable");
+	output_.writeLine(static_cast<char>(number));
+}
+
+// Arithmetic between two slots whose types are known: no depth check and no type switch
+template <typename L, typename R, e_Operation Op>
+void CommandsExecutor::typedArith()
+{
+	typedef PromotedType<L, R> P;
+	typedef typename std::conditional<std::is_integral<P>::value, int64_t, long double>::type W;
+
+	W lhs = OperandTraits<L>::get(stack_.payloadFromTop(1));
+	W rhs = OperandTraits<R>::get(stack_.payloadFromTop(0));
+	W result;
+
+	// Like div and mod, a failure leaves the stack without the right operand
+	stack_.pop();
+	if ((Op == DIV_T || Op == MOD_T) && rhs == 0)
+		throw DivModByZeroException();
+	if constexpr (Op == ADD_T)
+		result = lhs + rhs;
+	else if constexpr (Op == SUB_T)
+		result = lhs - rhs;
+	else if constexpr (Op == MUL_T)
+		result = lhs * rhs;
+	else if constexpr (Op == DIV_T)
+		result = lhs / rhs;
+	else if constexpr (std::is_integral<P>::value)
+		result = lhs % rhs;
+	else
+		result = std::fmod(lhs, rhs);
+	stack_.setTop(Value::narrow<P>(result));
+}
+
+// push v then <op>: the pushed value is the right operand of the top one
+template <e_Operation Op>
+void CommandsExecutor::pushArith(Value const & operand)
+{
+	static const char *names[] = {"add", "sub", "mul", "div", "mod"};
+
+	if (stack_.empty())
+		throw ImpossibleInstructionException(names[Op - PUSH_ADD]);
+	Value left = stack_.top();
+	if (Op == PUSH_ADD)
+		stack_.setTop(left + operand);
+	else if (Op == PUSH_SUB)
+		stack_.setTop(left - operand);
+	else if (Op == PUSH_MUL)
+		stack_.setTop(left * operand);
+	else if (Op == PUSH_DIV)
+		stack_.setTop(left / operand);
+	else
+		stack_.setTop(left % operand);
+}
+
+// swap then sub, with a depth already proven: the top value minus the one under it
+void CommandsExecutor::swapSub()
+{
+	Value left = stack_.top();
+	stack_.pop();
+	stack_.setTop(left - stack_.top());
+}
+
+template <e_Operation Op, std::size_t... Types>
+std::array<CommandsExecutor::t_TypedArith, 25> CommandsExecutor::typedArithRow(std::index_sequence<Types...>)
+{
+	return {{&CommandsExecutor::typedArith<NativeType<Types / 5>, NativeType<Types % 5>, Op>...}};
+}
+
+const std::array<CommandsExecutor::t_TypedArith, 25> CommandsExecutor::typedOps_[] = {
+	typedArithRow<ADD_T>(std::make_index_sequence<25>()),
+	typedArithRow<SUB_T>(std::make_index_sequence<25>()),
+	typedArithRow<MUL_T>(std::make_index_sequence<25>()),
+	typedArithRow<DIV_T>(std::make_index_sequence<25>()),
+	typedArithRow<MOD_T>(std::make_index_sequence<25>())
+};
 
+void CommandsExecutor::step(t_ParsedInstr const & instr)
+{
+	// e_Operation is dense, so this compiles down to a single jump table
+	switch (instr.instruction)
+	{
+		case PUSH:		push(Value(instr.operandType, instr.operand));		break;
+		case ASSERT:	assert(Value(instr.operandType, instr.operand));	break;
+		case POP:		pop();		break;
+		case SWAP:		swap();		break;
+		case DUMP:		dump();		break;
+		case ADD:		add();		break;
+		case SUB:		sub();		break;
+		case MUL:		mul();		break;
+		case DIV:		div();		break;
+		case MOD:		mod();		break;
+		case PRINT:		print();	break;
+		case SORT:		sort();		break;
+		case EXIT:		exit();		break;
+		case NONE:		break;
+		case POP_U:		stack_.pop();		break;
+		case SWAP_U:	stack_.swapTop();	break;
+		case ASSERT_U:	assertUnchecked(Value(instr.operandType, instr.operand));	break;
+		case PRINT_I8:	printInt8();	break;
+		case ADD_T: case SUB_T: case MUL_T: case DIV_T: case MOD_T:
+			(this->*typedOps_[instr.instruction - ADD_T][instr.variant])();
+			break;
+		case PUSH_ADD:	pushArith<PUSH_ADD>(Value(instr.operandType, instr.operand));	break;
+		case PUSH_SUB:	pushArith<PUSH_SUB>(Value(instr.operandType, instr.operand));	break;
+		case PUSH_MUL:	pushArith<PUSH_MUL>(Value(instr.operandType, instr.operand));	break;
+		case PUSH_DIV:	pushArith<PUSH_DIV>(Value(instr.operandType, instr.operand));	break;
+		case PUSH_MOD:	pushArith<PUSH_MOD>(Value(instr.operandType, instr.operand));	break;
+		case SWAP_SUB:	swapSub();	break;
+	}
+}
+
+// Everything the program printed so far comes before its error
+void CommandsExecutor::reportError(AVMException & e, std::size_t line)
+{
+	output_.flush();
+	e.pushError(line);
+	*errors_ << e.what() << std::endl;
+}
+
+void CommandsExecutor::execute(t_Program const & instructions)
+{
 	std::size_t line = 0;
 	try
 	{
-		for (auto& instr : instructions)
+		for (t_ParsedInstr const & instr : instructions)
 		{
 			line = instr.line;
-			if (argOps.count(instr.instruction))
-			{
-				const IOperand *tmp = instr.operand;
-				auto fn = argOps.at(instr.instruction);
-				instr.operand = nullptr;
-				(this->*fn)(tmp);
-			}
-			else if (noArgOps.count(instr.instruction))
-			{
-				auto fn = noArgOps.at(instr.instruction);
-				(this->*fn)();
-			}
-			instr.operand = nullptr;
+			step(instr);
 			if (exit_)
+			{
+				output_.flush();
 				return;
+			}
 		}
 		throw NoExitException();
 	}
 	catch (AVMException& e)
 	{
-		e.pushError(line);
-		std::cerr << e.what() << std::endl;
+		reportError(e, line);
+	}
+}
+
+bool CommandsExecutor::executeNext(t_ParsedInstr const & instr)
+{
+	try
+	{
+		step(instr);
+	}
+	catch (AVMException& e)
+	{
+		reportError(e, instr.line);
+		return false;
 	}
+	if (exit_)
+		output_.flush();
+	return !exit_;
+}
+
+// The input ended before an exit instruction
+void CommandsExecutor::endOfInput(std::size_t line)
+{
+	NoExitException e;
+	reportError(e, line);
+}
+
+// Runs the native translation of instructions: errors raised by the slow paths are
+// already reported, only running off the end of the program is left to report here
+void CommandsExecutor::execute(t_Program const & instructions, Jit const & jit)
+{
+	stack_.reserve(jit.maxDepth());
+	if (jit.run(*this) != Jit::Finished)
+	{
+		output_.flush();
+		return;
+	}
+
+	NoExitException e;
+	reportError(e, instructions.empty() ? 0 : instructions.back().line);
 }
@@ -0,0 +1,415 @@
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "CppEmitter.hpp"
+#include "Exceptions.hpp"
+
+// Instructions per generated function, so compilers never see one huge body
+static const std::size_t	s_blockSize = 4096;
+
+// Run-time errors the generated code can raise, in the order of its avm::Error enum
+static const e_ErrorType	s_runtimeErrors[] = {
+	e_ErrorType::OverflowException,
+	e_ErrorType::UnderflowException,
+	e_ErrorType::EmtpyStackException,
+	e_ErrorType::DivModByZeroException,
+	e_ErrorType::NoExitException,
+	e_ErrorType::FalseAssertException,
+	e_ErrorType::ImpossibleInstructionException,
+	e_ErrorType::InvalidPrintException
+};
+
+static const char	s_preludeHead[] = R"(#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+namespace avm
+{
+
+enum Type : uint8_t {Int8, Int16, Int32, Float, Double};
+enum Error {Overflow, Underflow, EmptyStack, DivModByZero, NoExit, FalseAssert, ImpossibleInstruction, InvalidPrint};
+enum Op {Add, Sub, Mul, Div, Mod};
+
+union Payload
+{
+	int8_t	i8;
+	int16_t	i16;
+	int32_t	i32;
+	float	f;
+	double	d;
+};
+
+struct Value
+{
+	Type	type;
+	Payload	p;
+};
+
+struct Failure
+{
+	std::size_t	line;
+	Error		error;
+	std::string	part;
+};
+
+static const char *const typeNames[] = {"int8", "int16", "int32", "float", "double"};
+)";
+
+static const char	s_preludeBody[] = R"(
+template <typename T> struct Traits;
+template <> struct Traits<int8_t> {static const Type type = Int8; static int8_t get(Payload const & p) {return p.i8;} static void set(Payload & p, int8_t v) {p.i8 = v;}};
+template <> struct Traits<int16_t> {static const Type type = Int16; static int16_t get(Payload const & p) {return p.i16;} static void set(Payload & p, int16_t v) {p.i16 = v;}};
+template <> struct Traits<int32_t> {static const Type type = Int32; static int32_t get(Payload const & p) {return p.i32;} static void set(Payload & p, int32_t v) {p.i32 = v;}};
+template <> struct Traits<float> {static const Type type = Float; static float get(Payload const & p) {return p.f;} static void set(Payload & p, float v) {p.f = v;}};
+template <> struct Traits<double> {static const Type type = Double; static double get(Payload const & p) {return p.d;} static void set(Payload & p, double v) {p.d = v;}};
+
+template <typename L, typename R>
+using Promoted = typename std::conditional<(Traits<L>::type >= Traits<R>::type), L, R>::type;
+
+template <typename T>
+inline Value make(T value)
+{
+	Value v;
+
+	v.type = Traits<T>::type;
+	v.p.d = 0;
+	Traits<T>::set(v.p, value);
+	return v;
+}
+
+template <typename R>
+inline R as(Value const & v)
+{
+	switch (v.type)
+	{
+		case Int8:	return static_cast<R>(v.p.i8);
+		case Int16:	return static_cast<R>(v.p.i16);
+		case Int32:	return static_cast<R>(v.p.i32);
+		case Float:	return static_cast<R>(v.p.f);
+		default:	return static_cast<R>(v.p.d);
+	}
+}
+
+[[noreturn]] inline void fail(std::size_t line, Error error, std::string part = "")
+{
+	throw Failure{line, error, part};
+}
+
+// Integer results are computed on int64_t, floating ones on long double, then range-checked
+template <typename R, typename V>
+inline Value narrow(std::size_t line, V value)
+{
+	if (value > std::numeric_limits<R>::max() || value < std::numeric_limits<R>::lowest())
+		fail(line, value > 0 ? Overflow : Underflow, std::to_string(value) + " is not " + typeNames[Traits<R>::type] + " type");
+	return make<R>(static_cast<R>(value));
+}
+
+template <Op O, typename L, typename R>
+inline Value arith(std::size_t line, Value const & lhs, Value const & rhs)
+{
+	typedef Promoted<L, R> P;
+	typedef typename std::conditional<std::is_integral<P>::value, int64_t, long double>::type W;
+
+	W a = Traits<L>::get(lhs.p);
+	W b = Traits<R>::get(rhs.p);
+
+	if ((O == Div || O == Mod) && b == 0)
+		fail(line, DivModByZero);
+	if constexpr (O == Add)
+		return narrow<P>(line, a + b);
+	else if constexpr (O == Sub)
+		return narrow<P>(line, a - b);
+	else if constexpr (O == Mul)
+		return narrow<P>(line, a * b);
+	else if constexpr (O == Div)
+		return narrow<P>(line, a / b);
+	else if constexpr (std::is_integral<P>::value)
+		return narrow<P>(line, a % b);
+	else
+		return narrow<P>(line, std::fmod(a, b));
+}
+
+template <Op O, typename L>
+inline Value arithRight(std::size_t line, Value const & lhs, Value const & rhs)
+{
+	switch (rhs.type)
+	{
+		case Int8:	return arith<O, L, int8_t>(line, lhs, rhs);
+		case Int16:	return arith<O, L, int16_t>(line, lhs, rhs);
+		case Int32:	return arith<O, L, int32_t>(line, lhs, rhs);
+		case Float:	return arith<O, L, float>(line, lhs, rhs);
+		default:	return arith<O, L, double>(line, lhs, rhs);
+	}
+}
+
+// For slots whose type depends on the values (after a sort mixing types)
+template <Op O>
+inline Value anyArith(std::size_t line, Value const & lhs, Value const & rhs)
+{
+	switch (lhs.type)
+	{
+		case Int8:	return arithRight<O, int8_t>(line, lhs, rhs);
+		case Int16:	return arithRight<O, int16_t>(line, lhs, rhs);
+		case Int32:	return arithRight<O, int32_t>(line, lhs, rhs);
+		case Float:	return arithRight<O, float>(line, lhs, rhs);
+		default:	return arithRight<O, double>(line, lhs, rhs);
+	}
+}
+
+inline bool equal(Value const & lhs, Value const & rhs)
+{
+	Type type = std::max(lhs.type, rhs.type);
+
+	if (type < Float)
+		return as<int64_t>(lhs) == as<int64_t>(rhs);
+	if (type == Float)
+		return as<float>(lhs) == as<float>(rhs);
+	return as<double>(lhs) == as<double>(rhs);
+}
+
+inline bool less(Value const & lhs, Value const & rhs)
+{
+	Type type = std::max(lhs.type, rhs.type);
+
+	if (type < Float)
+		return as<int64_t>(lhs) < as<int64_t>(rhs);
+	if (type == Float)
+		return as<float>(lhs) < as<float>(rhs);
+	return as<double>(lhs) < as<double>(rhs);
+}
+
+inline std::string toString(Value const & v)
+{
+	if (v.type < Float)
+		return std::to_string(as<int32_t>(v));
+
+	std::ostringstream oss;
+	if (v.type == Float)
+		oss << std::setprecision(std::numeric_limits<float>::digits10) << v.p.f;
+	else
+		oss << std::setprecision(std::numeric_limits<double>::digits10) << v.p.d;
+	return oss.str();
+}
+
+inline void assertEqual(std::size_t line, Value const & top, Value const & expected)
+{
+	if (!equal(top, expected))
+		fail(line, FalseAssert);
+}
+
+inline void print(std::size_t line, Value const & top)
+{
+	if (top.type != Int8)
+		fail(line, InvalidPrint, "not an int8");
+	if (!isprint(top.p.i8))
+		fail(line, InvalidPrint, toString(top) + " is not printable");
+	std::cout << top.p.i8 << std::endl;
+}
+
+inline void dump(Value const *stack, std::size_t depth)
+{
+	for (std::size_t i = depth; i > 0; --i)
+		std::cout << toString(stack[i - 1]) << std::endl;
+}
+
+inline void sort(Value *stack, std::size_t depth)
+{
+	std::stable_sort(stack, stack + depth, less);
+}
+
+inline std::string message(Failure const & failure)
+{
+	std::string text = "Error line " + std::to_string(failure.line) + ": " + explanations[failure.error];
+
+	if (!failure.part.empty())
+		text += " --> " + failure.part;
+	return text;
+}
+
+}
+
+using namespace avm;
+)";
+
+static std::string quoted(const char *text)
+{
+	std::string result = "\"";
+
+	for (const char *c = text; *c; ++c)
+	{
+		if (*c == '"' || *c == '\\')
+			result += '\\';
+		result += *c;
+	}
+	return result + "\"";
+}
+
+void CppEmitter::emitLiteral(std::ostream &out, t_ParsedInstr const & instr)
+{
+	switch (instr.operandType)
+	{
+		case Int8:
+			out << "make<int8_t>(" << static_cast<int>(instr.operand.i8) << ")";
+			break;
+		case Int16:
+			out << "make<int16_t>(" << instr.operand.i16 << ")";
+			break;
+		case Int32:
+			// Written as a long long so INT32_MIN stays a valid literal
+			out << "make<int32_t>(" << instr.operand.i32 << "LL)";
+			break;
+		case Float:
+			// Hexadecimal floating literals round-trip exactly
+			out << "make<float>(static_cast<float>(" << std::hexfloat << static_cast<double>(instr.operand.f) << std::defaultfloat << "))";
+			break;
+		default:
+			out << "make<double>(" << std::hexfloat << instr.operand.d << std::defaultfloat << ")";
+			break;
+	}
+}
+
+void CppEmitter::emitInstruction(std::ostream &out, t_ParsedInstr const & instr, std::size_t depth)
+{
+	static const char *types[] = {"int8_t", "int16_t", "int32_t", "float", "double"};
+	static const char *ops[] = {"Add", "Sub", "Mul", "Div", "Mod"};
+	static const char *names[] = {"add", "sub", "mul", "div", "mod"};
+	e_Operation op = genericOperation(instr.instruction);
+
+	out << "\t";
+	if (depth < requiredDepth(op))
+	{
+		if (op == SWAP)
+			out << "fail(" << instr.line << ", ImpossibleInstruction, \"swap\");\n";
+		else if (op >= ADD && op <= MOD)
+			out << "fail(" << instr.line << ", ImpossibleInstruction, \"" << names[op - ADD] << "\");\n";
+		else
+			out << "fail(" << instr.line << ", EmptyStack);\n";
+		return;
+	}
+	switch (op)
+	{
+		case PUSH:
+			out << "s[" << depth << "] = ";
+			emitLiteral(out, instr);
+			out << ";\n";
+			break;
+		case ASSERT:
+			out << "assertEqual(" << instr.line << ", s[" << depth - 1 << "], ";
+			emitLiteral(out, instr);
+			out << ");\n";
+			break;
+		case POP:
+			out << "// pop\n";
+			break;
+		case SWAP:
+			out << "std::swap(s[" << depth - 1 << "], s[" << depth - 2 << "]);\n";
+			break;
+		case DUMP:
+			out << "dump(s, " << depth << ");\n";
+			break;
+		case SORT:
+			out << "sort(s, " << depth << ");\n";
+			break;
+		case PRINT:
+			out << "print(" << instr.line << ", s[" << depth - 1 << "]);\n";
+			break;
+		case ADD: case SUB: case MUL: case DIV: case MOD:
+			out << "s[" << depth - 2 << "] = ";
+			if (instr.instruction >= ADD_T && instr.instruction <= MOD_T)
+				out << "arith<" << ops[op - ADD] << ", " << types[instr.variant / 5] << ", " << types[instr.variant % 5] << ">";
+			else
+				out << "anyArith<" << ops[op - ADD] << ">";
+			out << "(" << instr.line << ", s[" << depth - 2 << "], s[" << depth - 1 << "]);\n";
+			break;
+		case EXIT:
+			out << "return true;\n";
+			break;
+		default:
+			out << "// no-op\n";
+			break;
+	}
+}
+
+bool CppEmitter::write(t_Program const & program, const char *source, const char *path, std::string &error)
+{
+	std::ostringstream	out;
+	std::size_t			depth = 0;
+	std::size_t			maxDepth = 1;
+	std::size_t			blocks = 0;
+	std::size_t			lastLine = program.empty() ? 0 : program.back().line;
+	bool				stopped = false;
+	bool				exited = false;
+
+	out << "// Generated by avm --emit-cpp from " << source << ": build it with any C++17 compiler\n";
+	out << s_preludeHead << "\nstatic const char *const explanations[] = {\n";
+	for (e_ErrorType type : s_runtimeErrors)
+		out << "\t" << quoted(AVMException::explain(type)) << ",\n";
+	out << "};\n" << s_preludeBody;
+
+	std::ostringstream body;
+	for (std::size_t i = 0; i < program.size() && !stopped; ++i)
+	{
+		t_ParsedInstr const & instr = program[i];
+		e_Operation op = genericOperation(instr.instruction);
+
+		if (op > NONE)
+		{
+			error = "can't translate a fused instruction";
+			return false;
+		}
+		if (i % s_blockSize == 0)
+		{
+			if (i > 0)
+				body << "\treturn false;\n}\n\n";
+			body << "static bool block" << blocks++ << "(void)\n{\n";
+		}
+		emitInstruction(body, instr, depth);
+		// Nothing runs after exit or after an instruction certain to fail
+		exited = (op == EXIT);
+		stopped = (exited || depth < requiredDepth(op));
+		if (op == PUSH)
+			maxDepth = std::max(maxDepth, ++depth);
+		else if (op == POP || (op >= ADD && op <= MOD))
+			--depth;
+	}
+	if (blocks > 0)
+		body << (exited ? "}\n\n" : "\treturn false;\n}\n\n");
+
+	out << "\n[[maybe_unused]] static Value s[" << maxDepth << "];\n\n" << body.str();
+	out << "static bool (*const blocks[])(void) = {";
+	for (std::size_t i = 0; i < blocks; ++i)
+		out << (i > 0 ? ", " : "") << "block" << i;
+	if (blocks == 0)
+		out << "nullptr";
+	out << "};\n\n";
+	out << "int main(void)\n{\n";
+	out << "\ttry\n\t{\n";
+	out << "\t\tfor (bool (*block)(void) : blocks)\n";
+	out << "\t\t\tif (block != nullptr && block())\n";
+	out << "\t\t\t\treturn 0;\n";
+	out << "\t\tfail(" << lastLine << ", NoExit);\n";
+	out << "\t}\n\tcatch (Failure const & failure)\n\t{\n";
+	out << "\t\tstd::cerr << message(failure) << std::endl;\n";
+	out << "\t}\n\treturn 1;\n}\n";
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open())
+	{
+		error = std::string("could not create file ") + path;
+		return false;
+	}
+	file << out.str();
+	if (!file.good())
+	{
+		error = std::string("could not write file ") + path;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "Daemon.hpp"
+
+static bool readBytes(int fd, char *data, std::size_t size)
+{
+	while (size != 0)
+	{
+		ssize_t count = ::read(fd, data, size);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			return false;
+		data += count;
+		size -= count;
+	}
+	return true;
+}
+
+// A peer that went away must not raise SIGPIPE in the server
+static bool writeBytes(int fd, std::string const & data)
+{
+	std::size_t written = 0;
+
+	while (written < data.size())
+	{
+		ssize_t count = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			return false;
+		written += count;
+	}
+	return true;
+}
+
+static void putInteger(std::string &out, uint64_t value, std::size_t size)
+{
+	for (std::size_t i = 0; i < size; ++i)
+		out += static_cast<char>(value >> (8 * i));
+}
+
+static bool getInteger(int fd, uint64_t &value, std::size_t size)
+{
+	unsigned char bytes[8];
+
+	if (!readBytes(fd, reinterpret_cast<char *>(bytes), size))
+		return false;
+	value = 0;
+	for (std::size_t i = size; i > 0; --i)
+		value = (value << 8) | bytes[i - 1];
+	return true;
+}
+
+static void putFrame(std::string &out, std::string const & data)
+{
+	putInteger(out, data.size(), 8);
+	out += data;
+}
+
+// Read in pieces, so a bogus length only costs what the peer actually sends
+static bool getFrame(int fd, std::string &data)
+{
+	uint64_t	size;
+	char		chunk[1 << 16];
+
+	if (!getInteger(fd, size, 8))
+		return false;
+	data.clear();
+	while (size != 0)
+	{
+		std::size_t piece = std::min<uint64_t>(size, sizeof(chunk));
+
+		if (!readBytes(fd, chunk, piece))
+			return false;
+		data.append(chunk, piece);
+		size -= piece;
+	}
+	return true;
+}
+
+static bool toAddress(const char *path, sockaddr_un &address, std::string &error)
+{
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(address.sun_path))
+	{
+		error = std::string("socket path is too long: ") + path;
+		return false;
+	}
+	std::strcpy(address.sun_path, path);
+	return true;
+}
+
+static int connectTo(sockaddr_un const & address)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// A socket left behind by a server that is gone is replaced, a live one is not
+static bool claimPath(sockaddr_un const & address, std::string &error)
+{
+	struct stat st;
+
+	if (lstat(address.sun_path, &st) != 0)
+		return true;
+	if (!S_ISSOCK(st.st_mode))
+	{
+		error = std::string(address.sun_path) + " exists and is not a socket";
+		return false;
+	}
+	int fd = connectTo(address);
+	if (fd >= 0)
+	{
+		close(fd);
+		error = std::string(address.sun_path) + " is already served";
+		return false;
+	}
+	unlink(address.sun_path);
+	return true;
+}
+
+// Connections are watched one-shot: the worker woken for one is its only user until
+// it hands it back to epoll, or closes it
+static bool watch(int poller, int op, int fd)
+{
+	epoll_event event;
+
+	std::memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.fd = fd;
+	return epoll_ctl(poller, op, fd, &event) == 0;
+}
+
+bool Daemon::serve(const char *path, std::size_t jobs, t_Handler const & handler, std::string &error)
+{
+	sockaddr_un address;
+
+	if (!toAddress(path, address, error) || !claimPath(address, error))
+		return false;
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+		|| listen(listener, SOMAXCONN) != 0)
+	{
+		error = std::string("could not listen on ") + path + ": " + std::strerror(errno);
+		if (listener >= 0)
+			close(listener);
+		return false;
+	}
+	int poller = epoll_create1(EPOLL_CLOEXEC);
+	if (poller < 0 || !watch(poller, EPOLL_CTL_ADD, listener))
+	{
+		error = std::string("could not poll ") + path + ": " + std::strerror(errno);
+		if (poller >= 0)
+			close(poller);
+		close(listener);
+		return false;
+	}
+
+	// Every thread waits on the same epoll set for a new connection or a request
+	// on an idle one, so jobs bounds the programs running, not the clients connected
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < jobs; ++i)
+		threads.emplace_back(workerLoop, poller, listener, std::cref(handler));
+	for (std::thread &thread : threads)
+		thread.join();
+	close(poller);
+	close(listener);
+	error = std::string("stopped listening on ") + path;
+	return false;
+}
+
+void Daemon::workerLoop(int poller, int listener, t_Handler const & handler)
+{
+	epoll_event event;
+
+	for (;;)
+	{
+		int count = epoll_wait(poller, &event, 1, -1);
+
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count < 0)
+			return;
+		int fd = event.data.fd;
+		if (fd == listener)
+		{
+			acceptAll(poller, listener);
+			watch(poller, EPOLL_CTL_MOD, listener);
+		}
+		else if (!answerRequest(fd, handler) || !watch(poller, EPOLL_CTL_MOD, fd))
+			close(fd);
+	}
+}
+
+// Reads and writes on a connection block, but never longer than stallSeconds
+void Daemon::acceptAll(int poller, int listener)
+{
+	timeval stall = {stallSeconds, 0};
+
+	for (;;)
+	{
+		int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+
+		if (fd >= 0)
+		{
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &stall, sizeof(stall));
+			setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &stall, sizeof(stall));
+			if (!watch(poller, EPOLL_CTL_ADD, fd))
+				close(fd);
+		}
+		else if (errno == EINTR || errno == ECONNABORTED)
+			continue;
+		else
+		{
+			// Out of descriptors or memory: the pending connections wait for some to close
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			return;
+		}
+	}
+}
+
+// Answers the next request of the connection; false once it is closed or broken
+bool Daemon::answerRequest(int fd, t_Handler const & handler)
+{
+	uint64_t		optimize;
+	uint64_t		jit;
+	uint64_t		dumpFormat;
+	uint64_t		stackReserve;
+	t_Request		request;
+	Batch::t_Result	result;
+	std::string		response;
+
+	if (!getInteger(fd, optimize, 1) || !getInteger(fd, jit, 1) || !getInteger(fd, dumpFormat, 1)
+		|| dumpFormat > DumpBinary || !getInteger(fd, stackReserve, 8)
+		|| !getFrame(fd, request.file) || !getFrame(fd, request.program))
+		return false;
+	request.optimize = optimize != 0;
+	request.jit = jit != 0;
+	request.dumpFormat = static_cast<e_DumpFormat>(dumpFormat);
+	request.stackReserve = stackReserve;
+	if (stackReserve > maxStackReserve)
+	{
+		result.status = 1;
+		result.errors = "Error: the server reserves at most " + std::to_string(maxStackReserve) + " stack values.\n";
+	}
+	else
+	{
+		// Whatever a program throws ends that program, not the server
+		try
+		{
+			Batch::runProgram(nullptr, [&handler, &request](Vm &vm, const char *, std::ostream &out)
+			{
+				return handler(vm, request, out);
+			}, result);
+		}
+		catch (std::exception const & e)
+		{
+			result.status = 1;
+			result.output.clear();
+			result.errors = std::string("Error: ") + e.what() + "\n";
+		}
+	}
+	putInteger(response, result.status, 4);
+	putFrame(response, result.output);
+	putFrame(response, result.errors);
+	return writeBytes(fd, response);
+}
+
+bool Daemon::request(const char *path, t_Request const & request, Batch::t_Result &result, std::string &error)
+{
+	sockaddr_un	address;
+	std::string	message;
+	uint64_t	status;
+
+	if (!toAddress(path, address, error))
+		return false;
+	int fd = connectTo(address);
+	if (fd < 0)
+	{
+		error = std::string("could not connect to ") + path;
+		return false;
+	}
+	putInteger(message, request.optimize, 1);
+	putInteger(message, request.jit, 1);
+	putInteger(message, request.dumpFormat, 1);
+	putInteger(message, request.stackReserve, 8);
+	putFrame(message, request.file);
+	putFrame(message, request.program);
+	bool answered = writeBytes(fd, message) && getInteger(fd, status, 4)
+		&& getFrame(fd, result.output) && getFrame(fd, result.errors);
+	close(fd);
+	if (!answered)
+	{
+		error = std::string("lost the connection to ") + path;
+		return false;
+	}
+	result.status = static_cast<int>(status);
+	return true;
+}
@@ -3,7 +3,8 @@
 
 #include "Exceptions.hpp"
 
-std::list<Error> AVMException::errors_;
+thread_local std::list<Error> AVMException::threadErrors_;
+thread_local std::list<Error> *AVMException::errors_ = nullptr;
 
 AVMException::AVMException() {}
 
@@ -18,10 +19,23 @@ AVMException::AVMException(AVMException const & rhs) {(void)rhs;}
 AVMException::~AVMException() noexcept {}
 
 AVMException	&AVMException::operator=(AVMException const & rhs) {(void)rhs; return *this;}
- 
+
+std::list<Error> &AVMException::errors()
+{
+	return errors_ ? *errors_ : threadErrors_;
+}
+
+std::list<Error> *AVMException::collectErrors(std::list<Error> *errors)
+{
+	std::list<Error> *previous = errors_;
+
+	errors_ = errors;
+	return previous;
+}
+
 bool AVMException::isError()
 {
-	return !errors_.empty();
+	return !errors().empty();
 }
 
 static bool compareByLine(const Error& a, const Error& b)
@@ -31,15 +45,12 @@ static bool compareByLine(const Error& a, const Error& b)
 
 void AVMException::sortErrors()
 {
-	errors_.sort(compareByLine);
+	errors().sort(compareByLine);
 }
 
-static std::string builtErrorMessage(Error &error)
+const char* AVMException::explain(e_ErrorType type)
 {
-	std::string	errorMessage;
-	const char*	explanation = "Unknown error";
-
-	static const std::map<e_ErrorType, const char *> explain = {
+	static const std::map<e_ErrorType, const char *> explanations = {
 		{e_ErrorType::InvalidTypeException, "syntax error : unknown type"},
 		{e_ErrorType::MissingParException, "syntax error : missing parenthesis"},
 		{e_ErrorType::UnknownInstructionException, "unknown instruction"},
@@ -55,12 +66,18 @@ static std::string builtErrorMessage(Error &error)
 		{e_ErrorType::InvalidPrintException, "impossible to print"}
 	};
 
-	auto it = explain.find(error.type);
-	if (it != explain.end())
-		explanation = it->second;
+	auto it = explanations.find(type);
+	if (it != explanations.end())
+		return it->second;
+	return "Unknown error";
+}
+
+static std::string builtErrorMessage(Error &error)
+{
+	std::string	errorMessage;
 
 	std::ostringstream oss;
-	oss << "Error line " << error.line << ": " << explanation ;
+	oss << "Error line " << error.line << ": " << AVMException::explain(error.type);
 	if (!error.error_part.empty())
 		oss << " --> " << error.error_part;
 	errorMessage = oss.str();
@@ -68,20 +85,36 @@ static std::string builtErrorMessage(Error &error)
 	return errorMessage;
 }
 
-void AVMException::printErrors()
+void AVMException::printErrors(std::ostream &out)
 {
 	sortErrors();
 
-	for (Error& error : errors_)
-		std::cerr << builtErrorMessage(error) << std::endl;
+	for (Error& error : errors())
+		out << builtErrorMessage(error) << std::endl;
+}
+
+std::list<Error> AVMException::takeErrors()
+{
+	std::list<Error> taken;
+
+	taken.swap(errors());
+	return taken;
+}
+
+// Moves errors collected by another thread on a part of the program starting after lineOffset lines
+void AVMException::mergeErrors(std::list<Error> &merged, std::size_t lineOffset)
+{
+	for (Error& error : merged)
+		error.line += lineOffset;
+	errors().splice(errors().end(), merged);
 }
 
 void AVMException::pushError(std::size_t line)
 {
 	current_errors_.line = line;
 
-	errors_.push_back(current_errors_);
-	current_msg_ = builtErrorMessage(errors_.back());
+	errors().push_back(current_errors_);
+	current_msg_ = builtErrorMessage(errors().back());
 
 }
 
@@ -0,0 +1,55 @@
+#include "InstructionFuser.hpp"
+
+static bool isArith(e_Operation op, e_Operation generic)
+{
+	return (op == generic || op == ADD_T + (generic - ADD));
+}
+
+bool InstructionFuser::fusePair(t_ParsedInstr const & first, t_ParsedInstr const & second, t_ParsedInstr &fused)
+{
+	fused = first;
+	fused.line = second.line;
+	fused.variant = 0;
+	if (first.instruction == PUSH)
+	{
+		for (e_Operation op : {ADD, SUB, MUL, DIV, MOD})
+		{
+			if (isArith(second.instruction, op))
+			{
+				fused.instruction = static_cast<e_Operation>(PUSH_ADD + (op - ADD));
+				return true;
+			}
+		}
+		// The value under test is the one just pushed: the assert is decided now
+		if ((second.instruction == ASSERT || second.instruction == ASSERT_U)
+			&& Value(first.operandType, first.operand) == Value(second.operandType, second.operand))
+			return true;
+	}
+	else if (first.instruction == SWAP_U && isArith(second.instruction, SUB))
+	{
+		fused.instruction = SWAP_SUB;
+		return true;
+	}
+	return false;
+}
+
+void InstructionFuser::fuse(t_Program &program)
+{
+	std::size_t	out = 0;
+	std::size_t	i = 0;
+
+	while (i < program.size())
+	{
+		t_ParsedInstr fused;
+
+		if (i + 1 < program.size() && fusePair(program[i], program[i + 1], fused))
+		{
+			program[out] = fused;
+			i += 2;
+		}
+		else
+			program[out] = program[i++];
+		++out;
+	}
+	program.resize(out);
+}
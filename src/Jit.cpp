@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "Jit.hpp"
+#include "CommandsExecutor.hpp"
+#include "Exceptions.hpp"
+
+// Registers held by the generated code for its whole run (all callee-saved)
+//   rbx: types of the stack slots, r15: their payloads, r14: the t_Context
+// Slot n lives at [rbx + n] and [r15 + 8 * n]; rax, rcx and rdx are scratch
+//
+// Layout: a stub running a failed instruction through the interpreter, room for one
+// entry per typed arithmetic instruction loading its depth and address for the stub,
+// then the code run from entry_: prologue, one block per instruction, end of program
+// and epilogue. Entries sit before the code, so each one's place is known as soon as
+// the block that jumps to it is written
+
+static const std::size_t	maxJitDepth = std::numeric_limits<int32_t>::max() / sizeof(Payload);
+// Upper bound of the code emitted for one instruction (stepping into the interpreter
+// is the longest)
+static const std::size_t	maxInstrBytes = 64;
+static const std::size_t	frameBytes = 64;
+
+Jit::Jit(void) : code_(nullptr), length_(0), size_(0), entry_(0), nextFailure_(0), maxDepth_(0) {}
+
+Jit::~Jit(void)
+{
+	if (code_ != nullptr)
+		munmap(code_, size_);
+}
+
+Jit::Jit(Jit const & rhs) {(void)rhs;}
+
+Jit &Jit::operator=(Jit const & rhs) {(void)rhs; return *this;}
+
+bool Jit::isSupported(void)
+{
+#if defined(__x86_64__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::size_t Jit::maxDepth(void) const {return maxDepth_;}
+
+Jit::e_Status Jit::run(CommandsExecutor & executor) const
+{
+	t_Context	context = {&executor, 0, nullptr};
+	e_Status	status;
+
+	status = reinterpret_cast<t_Code>(code_ + entry_)(&context, executor.stack_.typeData(), executor.stack_.valueData());
+	// The stack is left as the interpreter would have left it
+	executor.stack_.setSize(context.depth);
+	if (status == Foreign)
+		std::rethrow_exception(context.foreign);
+	return status;
+}
+
+// The slow paths return Finished to let the native code go on
+
+Jit::e_Status Jit::stepHelper(t_Context *context, uint32_t depth, t_ParsedInstr const *instr)
+{
+	CommandsExecutor &executor = *context->executor;
+
+	try
+	{
+		executor.stack_.setSize(depth);
+		executor.step(*instr);
+	}
+	catch (AVMException& e)
+	{
+		executor.reportError(e, instr->line);
+		context->depth = static_cast<uint32_t>(executor.stack_.size());
+		return Failed;
+	}
+	catch (...)
+	{
+		context->foreign = std::current_exception();
+		context->depth = static_cast<uint32_t>(executor.stack_.size());
+		return Foreign;
+	}
+	return Finished;
+}
+
+static void put32(uint8_t *at, uint32_t value)
+{
+	std::memcpy(at, &value, sizeof(value));
+}
+
+static void put64(uint8_t *at, uint64_t value)
+{
+	std::memcpy(at, &value, sizeof(value));
+}
+
+// Copies a block of code and returns where it landed, for its fields to be filled in.
+// Immediates and displacements are little-endian, like the host
+uint8_t *Jit::emit(uint8_t const *bytes, std::size_t size)
+{
+	uint8_t *at = code_ + length_;
+
+	std::memcpy(at, bytes, size);
+	length_ += size;
+	return at;
+}
+
+// jump ends with a rel32 to the epilogue, patched once it is placed
+void Jit::emitJumpToEnd(uint8_t const *jump, std::size_t size)
+{
+	emit(jump, size);
+	endJumps_.push_back(length_ - 4);
+}
+
+// mov dword [r14 + depth], imm32: where the stack stands when the code returns
+void Jit::emitSetDepth(uint32_t depth)
+{
+	static_assert(offsetof(t_Context, depth) < 128, "the depth needs an 8-bit displacement");
+	static const uint8_t code[] = {0x41, 0xC7, 0x46, offsetof(t_Context, depth), 0, 0, 0, 0};
+
+	put32(emit(code, sizeof(code)) + 4, depth);
+}
+
+// Runs instr through the interpreter with the stack set to depth values
+void Jit::emitStep(uint32_t depth, t_ParsedInstr const & instr)
+{
+	static const uint8_t code[] = {
+		0x4C, 0x89, 0xF7,									// mov rdi, r14
+		0xBE, 0, 0, 0, 0,									// mov esi, depth
+		0x48, 0xBA, 0, 0, 0, 0, 0, 0, 0, 0,					// mov rdx, &instr
+		0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,					// mov rax, stepHelper
+		0xFF, 0xD0,											// call rax
+		0x85, 0xC0,											// test eax, eax
+		0x0F, 0x85, 0, 0, 0, 0};							// jnz end
+	uint8_t *at = code_ + length_;
+
+	emitJumpToEnd(code, sizeof(code));
+	put32(at + 4, depth);
+	put64(at + 10, reinterpret_cast<uintptr_t>(&instr));
+	put64(at + 20, reinterpret_cast<uintptr_t>(&Jit::stepHelper));
+}
+
+void Jit::emitPush(uint32_t depth, t_ParsedInstr const & instr)
+{
+	static const uint8_t small[] = {
+		0xC6, 0x83, 0, 0, 0, 0, 0,							// mov byte [rbx + depth], type
+		0x49, 0xC7, 0x87, 0, 0, 0, 0, 0, 0, 0, 0};			// mov qword [r15 + 8 * depth], imm32
+	static const uint8_t large[] = {
+		0xC6, 0x83, 0, 0, 0, 0, 0,							// mov byte [rbx + depth], type
+		0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,					// mov rax, payload
+		0x49, 0x89, 0x87, 0, 0, 0, 0};						// mov [r15 + 8 * depth], rax
+	uint64_t	payload;
+	uint8_t		*at;
+
+	std::memcpy(&payload, &instr.operand, sizeof(payload));
+	if (payload <= static_cast<uint64_t>(std::numeric_limits<int32_t>::max()))
+	{
+		at = emit(small, sizeof(small));
+		put32(at + 10, depth * sizeof(Payload));
+		put32(at + 14, static_cast<uint32_t>(payload));
+	}
+	else
+	{
+		at = emit(large, sizeof(large));
+		put64(at + 9, payload);
+		put32(at + 20, depth * sizeof(Payload));
+	}
+	put32(at + 2, depth);
+	at[6] = instr.operandType;
+}
+
+void Jit::emitSwap(uint32_t depth)
+{
+	static const uint8_t code[] = {
+		0x0F, 0xB6, 0x83, 0, 0, 0, 0,						// movzx eax, byte [rbx + top]
+		0x0F, 0xB6, 0x8B, 0, 0, 0, 0,						// movzx ecx, byte [rbx + under]
+		0x88, 0x8B, 0, 0, 0, 0,								// mov [rbx + top], cl
+		0x88, 0x83, 0, 0, 0, 0,								// mov [rbx + under], al
+		0x49, 0x8B, 0x87, 0, 0, 0, 0,						// mov rax, [r15 + 8 * top]
+		0x49, 0x8B, 0x8F, 0, 0, 0, 0,						// mov rcx, [r15 + 8 * under]
+		0x49, 0x89, 0x8F, 0, 0, 0, 0,						// mov [r15 + 8 * top], rcx
+		0x49, 0x89, 0x87, 0, 0, 0, 0};						// mov [r15 + 8 * under], rax
+	uint32_t	top = depth - 1;
+	uint32_t	under = depth - 2;
+	uint8_t		*at = emit(code, sizeof(code));
+
+	put32(at + 3, top);
+	put32(at + 10, under);
+	put32(at + 16, top);
+	put32(at + 22, under);
+	put32(at + 29, top * sizeof(Payload));
+	put32(at + 36, under * sizeof(Payload));
+	put32(at + 43, top * sizeof(Payload));
+	put32(at + 50, under * sizeof(Payload));
+}
+
+// Code of one typed integer arithmetic instruction, with the offsets of the fields that
+// depend on where it runs. It fails exactly when Value would, by jumping out before
+// touching the stack: the interpreter then runs the instruction again and reports it
+typedef struct s_ArithTemplate
+{
+	uint8_t	bytes[64];
+	uint8_t	size;
+	uint8_t	lhs;			// disp32 of the left operand
+	uint8_t	rhs;			// disp32 of the right operand
+	uint8_t	zeroJump;		// rel32 of the division by zero check, 0 without one
+	uint8_t	rangeJump;		// rel32 of the range check
+	uint8_t	result;			// disp32 of the stored payload
+	uint8_t	type;			// disp32 of the stored type, 0 when the left operand has it
+
+}	t_ArithTemplate;
+
+static uint8_t append(t_ArithTemplate &code, std::initializer_list<uint8_t> bytes)
+{
+	uint8_t at = code.size;
+
+	std::memcpy(code.bytes + code.size, bytes.begin(), bytes.size());
+	code.size += bytes.size();
+	return at;
+}
+
+// Sign-extends the integer of a slot into eax (or rax when wide), ecx (or rcx) for the
+// right operand
+static uint8_t appendLoad(t_ArithTemplate &code, e_OperandType type, bool rhs, bool wide)
+{
+	uint8_t modrm = rhs ? 0x8F : 0x87;
+	uint8_t rex = wide ? 0x49 : 0x41;
+
+	if (type == Int8)
+		append(code, {rex, 0x0F, 0xBE, modrm});				// movsx r, byte [r15 + disp32]
+	else if (type == Int16)
+		append(code, {rex, 0x0F, 0xBF, modrm});				// movsx r, word [r15 + disp32]
+	else if (wide)
+		append(code, {0x49, 0x63, modrm});					// movsxd r64, dword [r15 + disp32]
+	else
+		append(code, {0x41, 0x8B, modrm});					// mov r32, dword [r15 + disp32]
+	return append(code, {0, 0, 0, 0});
+}
+
+// Payloads are stored zero-extended, as Value builds them
+static t_ArithTemplate buildArith(e_Operation op, e_OperandType lhs, e_OperandType rhs)
+{
+	t_ArithTemplate	code = {};
+	e_OperandType	type = std::max(lhs, rhs);
+
+	if (op == DIV_T || op == MOD_T)
+	{
+		// On 64 bits: INT32_MIN / -1 must not fault
+		code.lhs = appendLoad(code, lhs, false, true);
+		code.rhs = appendLoad(code, rhs, true, true);
+		append(code, {0x48, 0x85, 0xC9, 0x0F, 0x84});		// test rcx, rcx; jz failure
+		code.zeroJump = append(code, {0, 0, 0, 0});
+		append(code, {0x48, 0x99, 0x48, 0xF7, 0xF9});		// cqo; idiv rcx
+		if (op == MOD_T)
+			append(code, {0x48, 0x89, 0xD0});				// mov rax, rdx
+		if (type == Int8)
+			append(code, {0x48, 0x0F, 0xBE, 0xD0});			// movsx rdx, al
+		else if (type == Int16)
+			append(code, {0x48, 0x0F, 0xBF, 0xD0});			// movsx rdx, ax
+		else
+			append(code, {0x48, 0x63, 0xD0});				// movsxd rdx, eax
+		append(code, {0x48, 0x39, 0xC2, 0x0F, 0x85});		// cmp rdx, rax; jne failure
+		code.rangeJump = append(code, {0, 0, 0, 0});
+	}
+	else
+	{
+		// On 32 bits: the overflow flag is the range check of int32, and the
+		// products of narrower types can't overflow it
+		code.lhs = appendLoad(code, lhs, false, false);
+		if (rhs == Int32)
+		{
+			if (op == ADD_T)
+				append(code, {0x41, 0x03, 0x87});			// add eax, [r15 + disp32]
+			else if (op == SUB_T)
+				append(code, {0x41, 0x2B, 0x87});			// sub eax, [r15 + disp32]
+			else
+				append(code, {0x41, 0x0F, 0xAF, 0x87});		// imul eax, [r15 + disp32]
+			code.rhs = append(code, {0, 0, 0, 0});
+		}
+		else
+		{
+			code.rhs = appendLoad(code, rhs, true, false);
+			if (op == ADD_T)
+				append(code, {0x01, 0xC8});					// add eax, ecx
+			else if (op == SUB_T)
+				append(code, {0x29, 0xC8});					// sub eax, ecx
+			else
+				append(code, {0x0F, 0xAF, 0xC1});			// imul eax, ecx
+		}
+		if (type == Int32)
+			append(code, {0x0F, 0x80});						// jo failure
+		else
+		{
+			// Fits when sign-extending its low bytes gives it back
+			append(code, {0x0F, type == Int8 ? uint8_t(0xBE) : uint8_t(0xBF), 0xD0});	// movsx edx, al or ax
+			append(code, {0x39, 0xC2, 0x0F, 0x85});			// cmp edx, eax; jne failure
+		}
+		code.rangeJump = append(code, {0, 0, 0, 0});
+	}
+	if (type == Int8)
+		append(code, {0x0F, 0xB6, 0xC0});					// movzx eax, al
+	else if (type == Int16)
+		append(code, {0x0F, 0xB7, 0xC0});					// movzx eax, ax
+	else if (op == DIV_T || op == MOD_T)
+		append(code, {0x89, 0xC0});							// mov eax, eax
+	append(code, {0x49, 0x89, 0x87});						// mov [r15 + disp32], rax
+	code.result = append(code, {0, 0, 0, 0});
+	if (lhs != type)
+	{
+		append(code, {0xC6, 0x83});							// mov byte [rbx + disp32], type
+		code.type = append(code, {0, 0, 0, 0});
+		append(code, {type});
+	}
+	return code;
+}
+
+// One template per operation and operand types, built on first use
+static t_ArithTemplate const & arithTemplate(e_Operation op, uint8_t variant)
+{
+	static const std::vector<t_ArithTemplate> templates = []
+	{
+		std::vector<t_ArithTemplate> built(5 * 25);
+
+		for (int op = ADD_T; op <= MOD_T; ++op)
+			for (int lhs = Int8; lhs <= Int32; ++lhs)
+				for (int rhs = Int8; rhs <= Int32; ++rhs)
+					built[(op - ADD_T) * 25 + lhs * 5 + rhs] = buildArith(static_cast<e_Operation>(op),
+						static_cast<e_OperandType>(lhs), static_cast<e_OperandType>(rhs));
+		return built;
+	}();
+
+	return templates[(op - ADD_T) * 25 + variant];
+}
+
+// False for anything but integer arithmetic
+bool Jit::emitIntegerArith(uint32_t depth, t_ParsedInstr const & instr)
+{
+	static const uint8_t entry[] = {
+		0xBE, 0, 0, 0, 0,									// mov esi, depth
+		0x48, 0xBA, 0, 0, 0, 0, 0, 0, 0, 0,					// mov rdx, &instr
+		0xE9, 0, 0, 0, 0};									// jmp stub
+
+	if (instr.instruction < ADD_T || instr.instruction > MOD_T
+		|| instr.variant / 5 > Int32 || instr.variant % 5 > Int32)
+		return false;
+
+	t_ArithTemplate const &	code = arithTemplate(instr.instruction, instr.variant);
+	uint32_t				slot = depth - 2;
+	uint8_t					*failure = code_ + nextFailure_;
+	uint8_t					*at = emit(code.bytes, code.size);
+
+	std::memcpy(failure, entry, sizeof(entry));
+	put32(failure + 1, depth);
+	put64(failure + 7, reinterpret_cast<uintptr_t>(&instr));
+	put32(failure + 16, static_cast<uint32_t>(-(nextFailure_ + sizeof(entry))));
+	nextFailure_ += sizeof(entry);
+
+	put32(at + code.lhs, slot * sizeof(Payload));
+	put32(at + code.rhs, (slot + 1) * sizeof(Payload));
+	if (code.zeroJump != 0)
+		put32(at + code.zeroJump, static_cast<uint32_t>(failure - (at + code.zeroJump + 4)));
+	put32(at + code.rangeJump, static_cast<uint32_t>(failure - (at + code.rangeJump + 4)));
+	put32(at + code.result, slot * sizeof(Payload));
+	if (code.type != 0)
+		put32(at + code.type, slot);
+	return true;
+}
+
+// The generated code keeps pointers to program's instructions, which must outlive it
+bool Jit::compile(t_Program const & program)
+{
+	static const uint8_t stub[] = {
+		0x4C, 0x89, 0xF7,									// mov rdi, r14 (esi, rdx: from the entry)
+		0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,					// mov rax, stepHelper
+		0xFF, 0xD0,											// call rax
+		0xE9, 0, 0, 0, 0};									// jmp end
+	static const uint8_t prologue[] = {
+		0x53, 0x41, 0x56, 0x41, 0x57,						// push rbx; push r14; push r15
+		0x49, 0x89, 0xFE,									// mov r14, rdi
+		0x48, 0x89, 0xF3,									// mov rbx, rsi
+		0x49, 0x89, 0xD7};									// mov r15, rdx
+	static const uint8_t finished[] = {0x31, 0xC0};		// xor eax, eax
+	static const uint8_t exited[] = {
+		0xB8, Exited, 0, 0, 0,								// mov eax, Exited
+		0xE9, 0, 0, 0, 0};									// jmp end
+	static const uint8_t epilogue[] = {0x41, 0x5F, 0x41, 0x5E, 0x5B, 0xC3};	// pop r15; pop r14; pop rbx; ret
+	static const std::size_t failureBytes = 20;
+
+	uint32_t	depth = 0;
+	std::size_t	arithmetic = 0;
+	std::size_t	page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	// Walked through pointers, which costs nothing even without optimizations
+	t_ParsedInstr const	*first = program.data();
+	t_ParsedInstr const	*last = first + program.size();
+
+	if (!isSupported() || program.size() > maxInstructions || program.size() >= maxJitDepth)
+		return false;
+	for (t_ParsedInstr const *instr = first; instr != last; ++instr)
+		if (instr->instruction >= ADD_T && instr->instruction <= MOD_T)
+			++arithmetic;
+	if (code_ != nullptr)
+		munmap(code_, size_);
+	endJumps_.clear();
+	maxDepth_ = 0;
+	length_ = 0;
+
+	// Sized for the worst case: only the pages actually written get backed by memory
+	std::size_t size = frameBytes + arithmetic * failureBytes + program.size() * maxInstrBytes;
+	void *buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (buffer == MAP_FAILED)
+	{
+		code_ = nullptr;
+		return false;
+	}
+	// Long programs get one page fault every 2 MiB of code instead of every 4 KiB
+	madvise(buffer, size, MADV_HUGEPAGE);
+	code_ = static_cast<uint8_t *>(buffer);
+	size_ = size;
+
+	uint8_t *at = code_ + length_;
+	emitJumpToEnd(stub, sizeof(stub));
+	put64(at + 5, reinterpret_cast<uintptr_t>(&Jit::stepHelper));
+	nextFailure_ = length_;
+	length_ += arithmetic * failureBytes;
+	entry_ = length_;
+
+	emit(prologue, sizeof(prologue));
+	for (t_ParsedInstr const *next = first; next != last; ++next)
+	{
+		t_ParsedInstr const &	instr = *next;
+		e_Operation				op = genericOperation(instr.instruction);
+
+		if (op > NONE)
+			return false;
+		if (op == EXIT)
+		{
+			emitSetDepth(depth);
+			emitJumpToEnd(exited, sizeof(exited));
+			break;
+		}
+		if (depth < requiredDepth(op))
+		{
+			// Certain to fail: the interpreter reports it
+			emitStep(depth, instr);
+			break;
+		}
+		switch (op)
+		{
+			case PUSH:
+				emitPush(depth++, instr);
+				break;
+			case POP:
+				--depth;
+				break;
+			case SWAP:
+				emitSwap(depth);
+				break;
+			case ADD: case SUB: case MUL: case DIV: case MOD:
+				if (!emitIntegerArith(depth, instr))
+					emitStep(depth, instr);
+				--depth;
+				break;
+			case NONE:
+				break;
+			default:
+				emitStep(depth, instr);
+				break;
+		}
+		if (depth > maxDepth_)
+			maxDepth_ = depth;
+	}
+
+	emitSetDepth(depth);
+	emit(finished, sizeof(finished));
+	std::size_t end = length_;
+	emit(epilogue, sizeof(epilogue));
+	for (std::size_t jump : endJumps_)
+		put32(code_ + jump, static_cast<uint32_t>(end - (jump + 4)));
+	endJumps_.clear();
+	endJumps_.shrink_to_fit();
+
+	// Written while writable, then switched to executable: never both at once
+	std::size_t used = (length_ + page - 1) / page * page;
+	if (used < size_)
+	{
+		munmap(code_ + used, size_ - used);
+		size_ = used;
+	}
+	return mprotect(code_, size_, PROT_READ | PROT_EXEC) == 0;
+}
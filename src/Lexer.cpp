@@ -1,69 +1,76 @@
+#include <cstring>
 #include "Lexer.hpp"
 
-Lexer* Lexer::s_instance = nullptr;
-
-Lexer& Lexer::getInstance() {return *s_instance;}
-
 Lexer &Lexer::operator=(Lexer const & rhs) {(void)rhs; return *this;}
 
 Lexer::Lexer(Lexer const & rhs) {(void)rhs;}
 
-Lexer::Lexer(void) {s_instance = this;}
+Lexer::Lexer(void) {}
 
-Lexer::~Lexer(void) {s_instance = nullptr;}
+Lexer::~Lexer(void) {}
 
-std::list<t_LexToken> Lexer::lexicalAnalisys(std::istream* input) const
+std::list<t_LexToken> Lexer::lexicalAnalisys(std::string_view source) const
 {
 	std::list<t_LexToken>	tokens;
-	std::string				line;
+	t_LexToken				token;
 	std::size_t				line_number = 0;
 
-	while (std::getline(*input, line))
+	while (nextToken(source, token, line_number))
+		tokens.push_back(token);
+	return tokens;
+}
+
+// Consumes lines from the front of source until the next instruction and lexes it
+// into token, so callers can take tokens one at a time
+bool Lexer::nextToken(std::string_view &source, t_LexToken &token, std::size_t &line_number) const
+{
+	while (!source.empty())
 	{
+		const char			*newline = static_cast<const char *>(std::memchr(source.data(), '\n', source.size()));
+		std::size_t			length = newline ? static_cast<std::size_t>(newline - source.data()) : source.size();
+		std::string_view	line = source.substr(0, length);
+
+		source.remove_prefix(newline ? length + 1 : length);
 		++line_number;
-		if (input == &std::cin && line == ";;")
-			break;
 		if (line.empty() || line[0] == ';')
 			continue;
 
-		t_LexToken token;
-
 		token.line = line_number;
-		std::string::size_type pos = line.find(' ');
-		if (pos == std::string::npos)
+		token.operandType = std::string_view();
+		token.literal = std::string_view();
+		std::string_view::size_type pos = line.find(' ');
+		if (pos == std::string_view::npos)
 			token.instruction = line;
 		else
 		{
 			token.instruction = line.substr(0, pos);
-			std::string rest = line.substr(pos + 1);
 			try
 			{
-				findOperandAndType(&token, rest);
+				findOperandAndType(&token, line.substr(pos + 1));
 			}
 			catch (AVMException &e)
 			{
 				e.pushError(line_number);
 			}
 		}
-
-		tokens.push_back(token);
+		return true;
 	}
-	return tokens;
+	return false;
 }
 
-void Lexer::findOperandAndType(t_LexToken *token, std::string rest) const
+void Lexer::findOperandAndType(t_LexToken *token, std::string_view rest) const
 {
 	std::size_t parenPos = rest.find('(');
-	if (parenPos != std::string::npos)
+	if (parenPos != std::string_view::npos)
 	{
 		token->operandType = rest.substr(0, parenPos);
 		std::size_t endParen = rest.find(')', parenPos);
-		if (endParen != std::string::npos)
+		if (endParen != std::string_view::npos)
 			token->literal = rest.substr(parenPos + 1, endParen - parenPos - 1);
 		else
 		{
 			token->literal = rest.substr(parenPos + 1);
-			throw MissingParException(rest);
+			throw MissingParException(std::string(rest));
 		}
 	}
-} 
+}
@@ -1,29 +1,52 @@
+#include <algorithm>
+#include <charconv>
+#include <limits>
 #include "Exceptions.hpp"
 #include "OperandFactory.hpp"
 #include "Operand.hpp"
 
-OperandFactory* OperandFactory::s_instance = nullptr;
-
-OperandFactory& OperandFactory::getInstance() {return *s_instance;}
 
 IOperand const *OperandFactory::createOperand(e_OperandType type, std::string const & value) const
 {
-	if (value.empty())
+	return createOperand(createValue(type, value));
+}
+
+Value OperandFactory::createValue(e_OperandType type, std::string_view literal) const
+{
+	if (literal.empty())
 		throw InvalidValueFormatException("cannot be empty");
-	if (!isValidValue(type, value))
-		throw InvalidValueFormatException(value);
 	switch (type)
 	{
 		case Int8:
-			return createInt8(value);
+			return parseInteger<int8_t>(literal);
 		case Int16:
-			return createInt16(value);
+			return parseInteger<int16_t>(literal);
 		case Int32:
-			return createInt32(value);
+			return parseInteger<int32_t>(literal);
 		case Float:
-			return createFloat(value);
+			return parseFloating<float>(literal);
 		case Double:
-			return createDouble(value);
+			return parseFloating<double>(literal);
+		default:
+			break;
+	}
+	return Value(); // impossible case
+}
+
+IOperand const *OperandFactory::createOperand(Value const & value) const
+{
+	switch (value.getType())
+	{
+		case Int8:
+			return new Operand<int8_t>(value.as<int8_t>());
+		case Int16:
+			return new Operand<int16_t>(value.as<int16_t>());
+		case Int32:
+			return new Operand<int32_t>(value.as<int32_t>());
+		case Float:
+			return new Operand<float>(value.as<float>());
+		case Double:
+			return new Operand<double>(value.as<double>());
 		default:
 			break;
 	}
@@ -34,162 +57,128 @@ OperandFactory &OperandFactory::operator=(OperandFactory const & rhs) {(void)rhs
 
 OperandFactory::OperandFactory(OperandFactory const & rhs) {(void)rhs;}
 
-OperandFactory::OperandFactory(void) {s_instance = this;}
+OperandFactory::OperandFactory(void) {}
 
-OperandFactory::~OperandFactory(void) {s_instance = nullptr;}
+OperandFactory::~OperandFactory(void) {}
 
-bool OperandFactory::isValidValue(e_OperandType type, std::string str) const
+static const char *typeName(e_OperandType type)
 {
-	if (str.empty())
-		return false;
-
-	size_t i = 0;
-	bool hasDot = (type < Float);
-	bool hasExp = (type < Float);
-
-	if (str[0] == '+' || str[0] == '-')
-		i++;
-
-	if (i == str.size())
-		return false;
+	static const char *names[] = {"int8", "int16", "int32", "float", "double"};
 
-	for (; i < str.size(); ++i)
-	{
-		if (str[i] == '.')
-		{
-			if (hasDot || hasExp)
-				return false;
-			hasDot = true;
-		}
-		else if (str[i] == 'e')
-		{
-			if (hasExp)
-				return false;
-			hasExp = true;
-		}
-		else if (!std::isdigit(str[i]))
-			return false;
-	}
-
-	return true;
+	return names[type];
 }
 
-IOperand const	*OperandFactory::createInt8(std::string const & value) const
+static void outOfRange(std::string_view literal, e_OperandType type)
 {
-	int64_t num = 0;
-	try
-	{
-		num = std::stoll(value);
-	}
-	catch (const std::invalid_argument&)
-	{
-		throw InvalidValueFormatException(value);
-	}
-	catch (const std::out_of_range&)
-	{
-		throw OverflowException(value + " is not int8 type");
-	}
+	std::string message = std::string(literal) + " is not " + typeName(type) + " type";
 
-	if (num > std::numeric_limits<int8_t>::max())
-		throw  OverflowException(value + " is not int8 type");
-	else if (num < std::numeric_limits<int8_t>::min())
-		throw  UnderflowException(value + " is not int8 type");
-	else
-		return (new Operand<int8_t>(static_cast<int8_t>(num)));
+	if (literal[0] == '-')
+		throw UnderflowException(message);
+	throw OverflowException(message);
 }
 
-IOperand const	*OperandFactory::createInt16(std::string const & value) const
+// [+-]digits
+template <typename T>
+Value OperandFactory::parseInteger(std::string_view literal) const
 {
-	int64_t num = 0;
-	try
-	{
-		num = std::stoll(value);
-	}
-	catch (const std::invalid_argument&)
-	{
-		throw InvalidValueFormatException(value);
-	}
-	catch (const std::out_of_range&)
-	{
-		throw OverflowException(value + " is not int16 type");
-	}
-
-	if (num > std::numeric_limits<int16_t>::max())
-		throw OverflowException(value + " is not int16 type");
-	else if (num < std::numeric_limits<int16_t>::min())
-		throw UnderflowException(value + " is not int16 type");
-	else
-		return (new Operand<int16_t>(static_cast<int16_t>(num)));
+	const char	*first = literal.data() + (literal[0] == '+' ? 1 : 0);
+	const char	*last = literal.data() + literal.size();
+	const char	*digits = literal.data() + ((literal[0] == '+' || literal[0] == '-') ? 1 : 0);
+	int64_t		num = 0;
+
+	if (digits == last || *digits < '0' || *digits > '9')
+		throw InvalidValueFormatException(std::string(literal));
+
+	std::from_chars_result result = std::from_chars(first, last, num);
+
+	if (result.ptr != last)
+		throw InvalidValueFormatException(std::string(literal));
+	if (result.ec == std::errc::result_out_of_range
+		|| num > std::numeric_limits<T>::max() || num < std::numeric_limits<T>::min())
+		outOfRange(literal, Value(T()).getType());
+	return Value(static_cast<T>(num));
 }
 
-IOperand const	*OperandFactory::createInt32(std::string const & value) const
+// Powers of ten up to 10^27 hold in the 64-bit significand of an x87 long double,
+// so for a mantissa below 2^64 one multiplication or division is correctly rounded:
+// exactly what strtold or from_chars would return. Narrower long doubles get fewer
+static const long double	s_powersOf10[] = {1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L,
+	1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L,
+	1e23L, 1e24L, 1e25L, 1e26L, 1e27L};
+static const int			s_maxExactPower = std::numeric_limits<long double>::digits >= 64 ? 27
+	: (std::numeric_limits<long double>::digits >= 53 ? 22 : 0);
+static const uint64_t		s_maxExactMantissa = std::numeric_limits<long double>::digits >= 64 ? std::numeric_limits<uint64_t>::max()
+	: (uint64_t(1) << std::numeric_limits<long double>::digits) - 1;
+
+// [+-] digits with at most one '.', then optionally 'e' and digits (no exponent sign).
+// A trailing 'e' without digits is ignored. The value is read as a long double and
+// then narrowed, so both types are range-checked the same way
+template <typename T>
+Value OperandFactory::parseFloating(std::string_view literal) const
 {
-	int64_t num = 0;
-	try
-	{
-		num = std::stoll(value);
-	}
-	catch (const std::invalid_argument&)
-	{
-		throw InvalidValueFormatException(value);
-	}
-	catch (const std::out_of_range&)
-	{
-		throw OverflowException(value + " is not int32 type");
+	std::size_t	start = (literal[0] == '+' || literal[0] == '-') ? 1 : 0;
+	std::size_t	end = literal.size();
+	std::size_t	digits = 0;
+	bool		hasDot = false;
+	bool		hasExp = false;
+	uint64_t	mantissa = 0;
+	int			significant = 0; // digits in mantissa, leading zeros excluded
+	int			exponent = 0;
+	int			fraction = 0;
+	long double	num = 0;
+
+	for (std::size_t i = start; i < literal.size(); ++i)
+	{
+		char c = literal[i];
+
+		if (c >= '0' && c <= '9')
+		{
+			if (hasExp)
+				exponent = std::min(exponent * 10 + (c - '0'), 100000);
+			else
+			{
+				++digits;
+				fraction += hasDot ? 1 : 0;
+				if (mantissa != 0 || c != '0')
+				{
+					mantissa = mantissa * 10 + (c - '0');
+					++significant;
+				}
+			}
+		}
+		else if (c == '.' && !hasDot && !hasExp)
+			hasDot = true;
+		else if (c == 'e' && !hasExp)
+		{
+			hasExp = true;
+			if (i + 1 == literal.size())
+				end = i;
+		}
+		else
+			throw InvalidValueFormatException(std::string(literal));
 	}
+	if (digits == 0)
+		throw InvalidValueFormatException(std::string(literal));
 
-	if (num > std::numeric_limits<int32_t>::max())
-		throw OverflowException(value + " is not int32 type");
-	else if (num < std::numeric_limits<int32_t>::min())
-		throw UnderflowException(value + " is not int32 type");
-	else
-		return (new Operand<int32_t>(static_cast<int32_t>(num)));
-}
-
-IOperand const	*OperandFactory::createFloat(std::string const & value) const
-{
-	long double num = 0;
-	try
+	int power = exponent - fraction;
+	if (significant <= 19 && mantissa <= s_maxExactMantissa && power >= -s_maxExactPower && power <= s_maxExactPower)
 	{
-		num = std::stold(value);
+		num = static_cast<long double>(mantissa);
+		num = (power >= 0 ? num * s_powersOf10[power] : num / s_powersOf10[-power]);
+		if (literal[0] == '-')
+			num = -num;
 	}
-	catch (const std::invalid_argument&)
-	{
-		throw InvalidValueFormatException(value);
-	}
-	catch (const std::out_of_range&)
-	{
-		throw OverflowException(value + " is not float type");
-	}
-
-	if (num > std::numeric_limits<float>::max())
-		throw OverflowException(value + " is not float type");
-	else if (num < std::numeric_limits<float>::lowest())
-		throw UnderflowException(value + " is not float type");
 	else
-		return (new Operand<float>(static_cast<float>(num)));
-}	
-
-IOperand const	*OperandFactory::createDouble(std::string const & value) const
-{
-	long double num = 0;
-	try
 	{
-		num = std::stold(value);
-	}
-	catch (const std::invalid_argument&)
-	{
-		throw InvalidValueFormatException(value);
-	}
-	catch (const std::out_of_range&)
-	{
-		throw OverflowException(value + " is not double type");
-	}
+		const char *first = literal.data() + (literal[0] == '+' ? 1 : 0);
+		std::from_chars_result result = std::from_chars(first, literal.data() + end, num);
 
-	if (num > std::numeric_limits<double>::max())
-		throw OverflowException(value + " is not double type");
-	else if (num < std::numeric_limits<double>::lowest())
-		throw UnderflowException(value + " is not double type");
-	else
-		return (new Operand<double>(static_cast<double>(num)));
+		if (result.ec == std::errc::result_out_of_range)
+			outOfRange(literal, Value(T()).getType());
+		if (result.ec != std::errc() || result.ptr != literal.data() + end)
+			throw InvalidValueFormatException(std::string(literal));
+	}
+	if (num > std::numeric_limits<T>::max() || num < std::numeric_limits<T>::lowest())
+		outOfRange(literal, Value(T()).getType());
+	return Value(static_cast<T>(num));
 }
@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "OperandStack.hpp"
+
+static_assert(sizeof(Payload) == 8, "stack payloads must stay packed on 8 bytes");
+
+OperandStack::OperandStack(void) : size_(0), capacity_(0) {}
+
+OperandStack::~OperandStack(void) {}
+
+OperandStack::OperandStack(OperandStack const & rhs) {(void)rhs;}
+
+OperandStack &OperandStack::operator=(OperandStack const & rhs) {(void)rhs; return *this;}
+
+void OperandStack::reserve(std::size_t capacity)
+{
+	if (capacity <= capacity_)
+		return;
+
+	std::unique_ptr<uint8_t[]> types(new uint8_t[capacity]);
+	std::unique_ptr<Payload[]> values(new Payload[capacity]);
+
+	if (size_ > 0)
+	{
+		std::memcpy(types.get(), types_.get(), size_ * sizeof(uint8_t));
+		std::memcpy(static_cast<void *>(values.get()), values_.get(), size_ * sizeof(Payload));
+	}
+	types_.swap(types);
+	values_.swap(values);
+	capacity_ = capacity;
+}
+
+std::size_t OperandStack::size(void) const {return size_;}
+
+bool OperandStack::empty(void) const {return size_ == 0;}
+
+void OperandStack::push(Value const & value)
+{
+	if (size_ == capacity_)
+		reserve(capacity_ < 16 ? 16 : capacity_ * 2);
+	types_[size_] = static_cast<uint8_t>(value.getType());
+	values_[size_] = value.getPayload();
+	++size_;
+}
+
+void OperandStack::pop(void)
+{
+	--size_;
+}
+
+Value OperandStack::top(void) const
+{
+	return Value(static_cast<e_OperandType>(types_[size_ - 1]), values_[size_ - 1]);
+}
+
+void OperandStack::setTop(Value const & value)
+{
+	types_[size_ - 1] = static_cast<uint8_t>(value.getType());
+	values_[size_ - 1] = value.getPayload();
+}
+
+Value OperandStack::at(std::size_t index) const
+{
+	return Value(static_cast<e_OperandType>(types_[index]), values_[index]);
+}
+
+void OperandStack::swapTop(void)
+{
+	std::swap(types_[size_ - 1], types_[size_ - 2]);
+	std::swap(values_[size_ - 1], values_[size_ - 2]);
+}
+
+static bool compareForStack(Value const & a, Value const & b)
+{
+	return a < b;
+}
+
+// Below this many values a comparison sort beats setting up a radix sort or threads
+static const std::size_t	s_radixMinSize = 256;
+static const std::size_t	s_minSizePerThread = 1 << 16;
+
+typedef struct s_IntKey
+{
+	uint32_t	key;	// int32 value with the sign bit flipped, so it orders as unsigned
+	uint32_t	type;
+
+}	t_IntKey;
+
+typedef struct s_DoubleKey
+{
+	double		key;
+	std::size_t	index;
+
+}	t_DoubleKey;
+
+static bool compareKeys(t_DoubleKey const & a, t_DoubleKey const & b)
+{
+	return a.key < b.key;
+}
+
+// Stable LSD radix sort, one byte per pass; passes where every key has the same byte are skipped
+static void radixSort(std::vector<t_IntKey> &keys)
+{
+	std::vector<t_IntKey>	buffer(keys.size());
+	std::size_t				counts[4][256] = {};
+
+	for (t_IntKey const & k : keys)
+		for (int pass = 0; pass < 4; ++pass)
+			++counts[pass][(k.key >> (8 * pass)) & 0xFF];
+	for (int pass = 0; pass < 4; ++pass)
+	{
+		std::size_t *count = counts[pass];
+		if (count[(keys[0].key >> (8 * pass)) & 0xFF] == keys.size())
+			continue;
+
+		std::size_t offset = 0;
+		for (int digit = 0; digit < 256; ++digit)
+		{
+			std::size_t n = count[digit];
+			count[digit] = offset;
+			offset += n;
+		}
+		for (t_IntKey const & k : keys)
+			buffer[count[(k.key >> (8 * pass)) & 0xFF]++] = k;
+		keys.swap(buffer);
+	}
+}
+
+// Sorts runs on separate threads then merges neighbours pairwise, also in parallel. With a
+// strict weak order, a stable sort has a single possible result, so it is the same as std::stable_sort's
+static void parallelStableSort(std::vector<t_DoubleKey> &keys)
+{
+	std::size_t threads = std::min<std::size_t>(std::thread::hardware_concurrency(), keys.size() / s_minSizePerThread);
+
+	if (threads < 2)
+		return std::stable_sort(keys.begin(), keys.end(), compareKeys);
+
+	std::vector<std::size_t>	bounds;
+	std::vector<std::thread>	workers;
+
+	for (std::size_t i = 0; i <= threads; ++i)
+		bounds.push_back(keys.size() * i / threads);
+	for (std::size_t i = 0; i < threads; ++i)
+		workers.emplace_back([&keys, &bounds, i]()
+		{
+			std::stable_sort(keys.begin() + bounds[i], keys.begin() + bounds[i + 1], compareKeys);
+		});
+	for (std::thread &worker : workers)
+		worker.join();
+	while (bounds.size() > 2)
+	{
+		std::vector<std::size_t> merged;
+
+		workers.clear();
+		for (std::size_t i = 0; i + 2 < bounds.size(); i += 2)
+		{
+			workers.emplace_back([&keys, &bounds, i]()
+			{
+				std::inplace_merge(keys.begin() + bounds[i], keys.begin() + bounds[i + 1], keys.begin() + bounds[i + 2], compareKeys);
+			});
+			merged.push_back(bounds[i]);
+		}
+		if (bounds.size() % 2 == 0)
+			merged.push_back(bounds[bounds.size() - 2]);
+		merged.push_back(bounds.back());
+		for (std::thread &worker : workers)
+			worker.join();
+		bounds.swap(merged);
+	}
+}
+
+static Payload intPayload(e_OperandType type, int32_t value)
+{
+	Payload payload;
+
+	payload.d = 0;
+	if (type == Int8)
+		payload.i8 = static_cast<int8_t>(value);
+	else if (type == Int16)
+		payload.i16 = static_cast<int16_t>(value);
+	else
+		payload.i32 = value;
+	return payload;
+}
+
+// Values compare after promotion to the wider type. When that conversion is exact for every pair,
+// comparing them all as doubles orders them the same way, which allows radix and parallel sorts.
+// It isn't for an int32 beyond 2^24 against a float, nor for NaN: those stacks keep the comparison sort
+void OperandStack::sort(void)
+{
+	bool	integers = true;
+	bool	floats = false;
+	bool	exact = true;
+	bool	largeInt32 = false;
+
+	for (std::size_t i = 0; i < size_; ++i)
+	{
+		e_OperandType type = static_cast<e_OperandType>(types_[i]);
+
+		if (type == Int32 && (values_[i].i32 > (1 << 24) || values_[i].i32 < -(1 << 24)))
+			largeInt32 = true;
+		else if (type == Float)
+			floats = true;
+		if (type >= Float)
+		{
+			integers = false;
+			exact = exact && !std::isnan(type == Float ? values_[i].f : values_[i].d);
+		}
+	}
+	exact = exact && !(floats && largeInt32);
+
+	if (size_ < s_radixMinSize || !exact)
+	{
+		std::vector<Value> values;
+
+		values.reserve(size_);
+		for (std::size_t i = 0; i < size_; ++i)
+			values.push_back(at(i));
+		std::stable_sort(values.begin(), values.end(), compareForStack);
+		for (std::size_t i = 0; i < size_; ++i)
+		{
+			types_[i] = static_cast<uint8_t>(values[i].getType());
+			values_[i] = values[i].getPayload();
+		}
+	}
+	else if (integers)
+	{
+		std::vector<t_IntKey> keys(size_);
+
+		for (std::size_t i = 0; i < size_; ++i)
+			keys[i] = {static_cast<uint32_t>(at(i).as<int32_t>()) ^ 0x80000000u, types_[i]};
+		radixSort(keys);
+		for (std::size_t i = 0; i < size_; ++i)
+		{
+			types_[i] = static_cast<uint8_t>(keys[i].type);
+			values_[i] = intPayload(static_cast<e_OperandType>(keys[i].type), static_cast<int32_t>(keys[i].key ^ 0x80000000u));
+		}
+	}
+	else
+	{
+		std::vector<t_DoubleKey>	keys(size_);
+		std::vector<uint8_t>		types(types_.get(), types_.get() + size_);
+		std::vector<Payload>		values(values_.get(), values_.get() + size_);
+
+		for (std::size_t i = 0; i < size_; ++i)
+			keys[i] = {at(i).as<double>(), i};
+		parallelStableSort(keys);
+		for (std::size_t i = 0; i < size_; ++i)
+		{
+			types_[i] = types[keys[i].index];
+			values_[i] = values[keys[i].index];
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#include "Optimizer.hpp"
+#include "Exceptions.hpp"
+
+static long depthEffect(e_Operation op)
+{
+	switch (op)
+	{
+		case PUSH:
+			return 1;
+		case POP: case ADD: case SUB: case MUL: case DIV: case MOD:
+			return -1;
+		default:
+			return 0;
+	}
+}
+
+static Value operandOf(t_ParsedInstr const & instr)
+{
+	return Value(instr.operandType, instr.operand);
+}
+
+// Replaces push a, push b, <arith> by push (a <arith> b), unless computing it raises an
+// error, in which case the instructions are kept so the error still happens at run time
+bool Optimizer::fold(t_Program &out)
+{
+	std::size_t		n = out.size();
+	Value			lhs = operandOf(out[n - 3]);
+	Value			rhs = operandOf(out[n - 2]);
+	Value			result;
+
+	try
+	{
+		switch (out[n - 1].instruction)
+		{
+			case ADD:	result = lhs + rhs;	break;
+			case SUB:	result = lhs - rhs;	break;
+			case MUL:	result = lhs * rhs;	break;
+			case DIV:	result = lhs / rhs;	break;
+			case MOD:	result = lhs % rhs;	break;
+			default:	return false;
+		}
+	}
+	catch (AVMException &)
+	{
+		return false;
+	}
+	out.resize(n - 2);
+	out.back().operandType = result.getType();
+	out.back().operand = result.getPayload();
+	return true;
+}
+
+// Every rewrite keeps the stack depth seen by the following instructions
+bool Optimizer::reduce(t_Program &out)
+{
+	std::size_t n = out.size();
+
+	if (n >= 2 && out[n - 2].instruction == PUSH && out[n - 1].instruction == POP)
+	{
+		out.resize(n - 2);
+		return true;
+	}
+	if (n >= 2 && out[n - 2].instruction == PUSH && out[n - 1].instruction == ASSERT
+		&& operandOf(out[n - 2]) == operandOf(out[n - 1]))
+	{
+		out.pop_back();
+		return true;
+	}
+	if (n >= 2 && out[n - 2].instruction == SWAP && out[n - 1].instruction == SWAP)
+	{
+		out.resize(n - 2);
+		return true;
+	}
+	if (n >= 3 && out[n - 3].instruction == PUSH && out[n - 2].instruction == PUSH)
+		return fold(out);
+	return false;
+}
+
+void Optimizer::optimize(t_Program &program)
+{
+	t_Program	out;
+	std::size_t	depth = 0;
+	bool		terminated = false;
+
+	if (program.empty())
+		return;
+	out.reserve(program.size());
+	for (t_ParsedInstr const & instr : program)
+	{
+		// Nothing after an exit or a guaranteed stack error is ever executed
+		if (depth < requiredDepth(instr.instruction) || instr.instruction == EXIT)
+		{
+			out.push_back(instr);
+			terminated = true;
+			break;
+		}
+		out.push_back(instr);
+		depth += depthEffect(instr.instruction);
+		// Only instructions that cannot underflow reach out, so rewrites never hide a stack error
+		while (reduce(out))
+			;
+	}
+	// Falling off the end reports a missing exit on the last source line: keep it
+	if (!terminated && (out.empty() || out.back().line != program.back().line))
+		out.push_back({NONE, NoType, 0, program.back().line, Payload()});
+	out.shrink_to_fit();
+	program.swap(out);
+}
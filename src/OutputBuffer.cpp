@@ -0,0 +1,244 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "OutputBuffer.hpp"
+
+OutputBuffer::OutputBuffer(int fd)
+	: fd_(fd), data_(new char[s_capacity]), size_(0), capacity_(s_capacity),
+	policy_(isatty(fd) ? FlushLine : FlushFull), held_(false), submitted_(0), completed_(0),
+	sleeping_(false) {}
+
+OutputBuffer::~OutputBuffer(void)
+{
+	flush();
+	if (writer_.joinable())
+	{
+		written_->push(t_Chunk());
+		wakeWriter();
+		writer_.join();
+	}
+}
+
+OutputBuffer &OutputBuffer::operator=(OutputBuffer const & rhs) {(void)rhs; return *this;}
+
+OutputBuffer::OutputBuffer(OutputBuffer const & rhs) {(void)rhs;}
+
+void OutputBuffer::setPolicy(e_FlushPolicy policy)
+{
+	policy_ = policy;
+}
+
+void OutputBuffer::startWriter(void)
+{
+	if (writer_.joinable())
+		return;
+	written_.reset(new t_ChunkRing());
+	spare_.reset(new t_ChunkRing());
+	writer_ = std::thread(&OutputBuffer::writerLoop, this);
+}
+
+// Room for size more bytes: hands the buffer over first when the policy allows it, grows otherwise
+char *OutputBuffer::reserve(std::size_t size)
+{
+	if (size_ + size > capacity_ && !held_ && policy_ != FlushExit)
+		handOff();
+	if (size_ + size > capacity_)
+	{
+		std::size_t capacity = capacity_ * 2;
+		while (capacity < size_ + size)
+			capacity *= 2;
+		std::unique_ptr<char[]> data(new char[capacity]);
+		std::memcpy(data.get(), data_.get(), size_);
+		data_ = std::move(data);
+		capacity_ = capacity;
+	}
+	return data_.get() + size_;
+}
+
+void OutputBuffer::endLine(char *end)
+{
+	*end++ = '\n';
+	size_ = end - data_.get();
+	if (policy_ == FlushLine && !held_)
+		handOff();
+}
+
+void OutputBuffer::writeLine(Value const & value)
+{
+	endLine(value.format(reserve(Value::maxFormattedSize + 1)));
+}
+
+void OutputBuffer::writeLine(char c)
+{
+	char *end = reserve(2);
+
+	*end++ = c;
+	endLine(end);
+}
+
+// Copied in pieces no larger than a buffer, so a large write is handed over as it goes
+void OutputBuffer::write(const char *data, std::size_t size)
+{
+	while (size != 0)
+	{
+		std::size_t piece = size < s_capacity ? size : s_capacity;
+
+		std::memcpy(reserve(piece), data, piece);
+		size_ += piece;
+		data += piece;
+		size -= piece;
+	}
+}
+
+void OutputBuffer::write(Value const & value, bool roundTrip)
+{
+	size_ = value.format(reserve(Value::maxFormattedSize), roundTrip) - data_.get();
+}
+
+void OutputBuffer::newLine(void)
+{
+	endLine(reserve(1));
+}
+
+void OutputBuffer::writeAll(const char *data, std::size_t size) const
+{
+	std::size_t written = 0;
+
+	while (written < size)
+	{
+		ssize_t count = ::write(fd_, data + written, size - written);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			break;
+		written += count;
+	}
+}
+
+// Writes the buffer, or passes it to the writer thread without waiting: when the writer is
+// behind and its ring is full, the buffer is kept and keeps growing until the next try
+void OutputBuffer::handOff(void)
+{
+	if (size_ == 0)
+		return;
+	if (!writer_.joinable())
+	{
+		writeAll(data_.get(), size_);
+		size_ = 0;
+		return;
+	}
+
+	t_Chunk chunk = {std::move(data_), size_, capacity_};
+	if (!written_->tryPush(chunk))
+	{
+		data_ = std::move(chunk.data);
+		return;
+	}
+	++submitted_;
+	wakeWriter();
+	takeSpare();
+}
+
+// Continues in a buffer the writer is done with, or in a new one
+void OutputBuffer::takeSpare(void)
+{
+	t_Chunk chunk;
+
+	if (spare_->tryPop(chunk))
+	{
+		data_ = std::move(chunk.data);
+		capacity_ = chunk.capacity;
+	}
+	else
+	{
+		data_.reset(new char[s_capacity]);
+		capacity_ = s_capacity;
+	}
+	size_ = 0;
+}
+
+void OutputBuffer::flush(void)
+{
+	if (held_)
+		return;
+	if (!writer_.joinable())
+	{
+		writeAll(data_.get(), size_);
+		size_ = 0;
+		return;
+	}
+	if (size_ != 0)
+	{
+		t_Chunk chunk = {std::move(data_), size_, capacity_};
+		written_->push(std::move(chunk));
+		++submitted_;
+		wakeWriter();
+		takeSpare();
+	}
+	for (unsigned int spins = 0; completed_.load(std::memory_order_acquire) != submitted_; ++spins)
+		t_ChunkRing::wait(spins);
+}
+
+// The fences order each side's store before its load of the other side's state, so either
+// the writer sees the new chunk or the executor sees it sleeping and wakes it up
+void OutputBuffer::waitForChunk(void)
+{
+	std::unique_lock<std::mutex> lock(idleLock_);
+
+	sleeping_.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while (written_->empty())
+		idle_.wait(lock);
+	sleeping_.store(false, std::memory_order_relaxed);
+}
+
+void OutputBuffer::wakeWriter(void)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping_.load(std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> lock(idleLock_);
+		idle_.notify_one();
+	}
+}
+
+void OutputBuffer::writerLoop(void)
+{
+	t_Chunk chunk;
+
+	for (;;)
+	{
+		if (!written_->tryPop(chunk))
+		{
+			waitForChunk();
+			continue;
+		}
+		if (!chunk.data)
+			break;
+		writeAll(chunk.data.get(), chunk.size);
+		chunk.size = 0;
+		completed_.fetch_add(1, std::memory_order_release);
+		// Dropped when the executor already has enough spare buffers
+		spare_->tryPush(chunk);
+	}
+}
+
+void OutputBuffer::hold(void)
+{
+	held_ = true;
+}
+
+void OutputBuffer::release(bool write)
+{
+	held_ = false;
+	if (!write)
+		size_ = 0;
+	flush();
+}
+
+void OutputBuffer::release(std::string &out)
+{
+	out.append(data_.get(), size_);
+	size_ = 0;
+	held_ = false;
+}
@@ -1,109 +1,269 @@
 #include "Parser.hpp"
-#include <map>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <thread>
 
-Parser* Parser::s_instance = nullptr;
-
-Parser& Parser::getInstance() {return *s_instance;}
+static_assert(sizeof(t_ParsedInstr) == 16, "instructions must stay packed on 16 bytes");
 
 Parser &Parser::operator=(Parser const & rhs) {(void)rhs; return *this;}
 
-Parser::Parser(Parser const & rhs) {(void)rhs;}
+Parser::Parser(Parser const & rhs) : lexer_(rhs.lexer_), factory_(rhs.factory_) {}
 
-Parser::Parser(void) {s_instance = this;}
+Parser::Parser(Lexer const & lexer, OperandFactory const & factory) : lexer_(lexer), factory_(factory) {}
 
-Parser::~Parser(void) {s_instance = nullptr;}
+Parser::~Parser(void) {}
 
-e_Operation Parser::toOperation(const std::string& opStr) const
+// Perfect hashes on the first and last characters and the length: each name has its
+// own slot, so a lookup is one hash and one comparison
+static std::size_t operationSlot(std::string_view name)
 {
-	static const std::map<std::string, e_Operation> opMap = {
-		{"push", PUSH},
-		{"pop", POP},
-		{"swap", SWAP},
-		{"dump", DUMP},
-		{"assert", ASSERT},
-		{"add", ADD},
-		{"sub", SUB},
-		{"mul", MUL},
-		{"div", DIV},
-		{"mod", MOD},
-		{"print", PRINT},
-		{"sort", SORT},
-		{"exit", EXIT}
-	};
+	return (name[0] * 3 + name.back() + name.size()) & 31;
+}
+
+static std::size_t typeSlot(std::string_view name)
+{
+	return (name[0] + name.back() * 3 + name.size()) & 7;
+}
 
-	auto it = opMap.find(opStr);
-	if (it == opMap.end())
-		throw UnknownInstructionException(opStr);
+typedef struct s_OperationName
+{
+	std::string_view	name;
+	e_Operation			operation;
+
+}	t_OperationName;
+
+typedef struct s_TypeName
+{
+	std::string_view	name;
+	e_OperandType		type;
+
+}	t_TypeName;
 
-	return it->second;
+static std::array<t_OperationName, 32> operationTable(void)
+{
+	static const t_OperationName names[] = {
+		{"push", PUSH}, {"pop", POP}, {"swap", SWAP}, {"dump", DUMP}, {"assert", ASSERT},
+		{"add", ADD}, {"sub", SUB}, {"mul", MUL}, {"div", DIV}, {"mod", MOD},
+		{"print", PRINT}, {"sort", SORT}, {"exit", EXIT}
+	};
+	std::array<t_OperationName, 32> table = {};
+
+	for (t_OperationName const & entry : names)
+		table[operationSlot(entry.name)] = entry;
+	return table;
 }
 
-e_OperandType Parser::toType(const std::string& type) const
+static std::array<t_TypeName, 8> typeTable(void)
 {
-	static const std::map<std::string, e_OperandType> typeMap = {
-		{"int8", Int8},
-		{"int16", Int16},
-		{"int32", Int32},
-		{"float", Float},
-		{"double", Double}
+	static const t_TypeName names[] = {
+		{"int8", Int8}, {"int16", Int16}, {"int32", Int32}, {"float", Float}, {"double", Double}
 	};
+	std::array<t_TypeName, 8> table = {};
+
+	for (t_TypeName const & entry : names)
+		table[typeSlot(entry.name)] = entry;
+	return table;
+}
 
-	auto it = typeMap.find(type);
-	if (it == typeMap.end())
-		throw InvalidTypeException(type);
+e_Operation Parser::toOperation(std::string_view opStr) const
+{
+	static const std::array<t_OperationName, 32> table = operationTable();
 
-	return it->second;
+	if (!opStr.empty())
+	{
+		t_OperationName const & entry = table[operationSlot(opStr)];
+		if (entry.name == opStr)
+			return entry.operation;
+	}
+	throw UnknownInstructionException(std::string(opStr));
 }
 
-std::list<t_ParsedInstr> Parser::parse(std::list<t_LexToken> &lexTokens) const
+e_OperandType Parser::toType(std::string_view type) const
 {
-	std::list<t_ParsedInstr>	parsTokens;
+	static const std::array<t_TypeName, 8> table = typeTable();
+
+	if (!type.empty())
+	{
+		t_TypeName const & entry = table[typeSlot(type)];
+		if (entry.name == type)
+			return entry.type;
+	}
+	throw InvalidTypeException(std::string(type));
+}
 
-	for (const t_LexToken& lexToken : lexTokens)
+t_ParsedInstr Parser::parseToken(t_LexToken const & lexToken) const
+{
+	t_ParsedInstr	parsToken = {NONE, NoType, 0, static_cast<uint32_t>(lexToken.line), Payload()};
+	try
+	{
+		parsToken.instruction = toOperation(lexToken.instruction);
+	}
+	catch (AVMException &e)
 	{
-		t_ParsedInstr	parsToken = {NONE, NoType, nullptr, lexToken.line};
+		e.pushError(lexToken.line);
+	}
+	if (parsToken.instruction <= ASSERT)
+	{
+		e_OperandType type = NoType;
 		try
 		{
-			parsToken.instruction = toOperation(lexToken.instruction);
+			type = toType(lexToken.operandType);
 		}
 		catch (AVMException &e)
 		{
 			e.pushError(lexToken.line);
 		}
-		if (parsToken.instruction <= ASSERT)
-		{
-			try
-			{
-				parsToken.operandType = toType(lexToken.operandType);
-			}
-			catch (AVMException &e)
-			{
-				e.pushError(lexToken.line);
-			}
 
-			try
-			{
-				parsToken.operand = OperandFactory::getInstance().createOperand(parsToken.operandType, lexToken.literal);
-			}
-			catch (AVMException &e)
-			{
-				e.pushError(lexToken.line);
-			}
+		try
+		{
+			Value value = factory_.createValue(type, lexToken.literal);
+			parsToken.operandType = value.getType();
+			parsToken.operand = value.getPayload();
 		}
-		else if (!lexToken.operandType.empty() || !lexToken.literal.empty())
+		catch (AVMException &e)
 		{
-			NoValueExpectedException e;
 			e.pushError(lexToken.line);
 		}
+	}
+	else if (!lexToken.operandType.empty() || !lexToken.literal.empty())
+	{
+		NoValueExpectedException e;
+		e.pushError(lexToken.line);
+	}
+	return parsToken;
+}
 
-		parsTokens.push_back(parsToken);
+// Lexes and parses one line at a time, so no token outlives its instruction
+t_Program Parser::parseLines(std::string_view source, std::size_t &line_number) const
+{
+	t_Program	instructions;
+	t_LexToken	lexToken;
+
+	while (lexer_.nextToken(source, lexToken, line_number))
+		instructions.push_back(parseToken(lexToken));
+	return instructions;
+}
+
+// Parses the next instruction of source, for callers running instructions as they are read
+bool Parser::parseNext(std::string_view &source, std::size_t &line_number, t_ParsedInstr &instr) const
+{
+	t_LexToken lexToken;
+
+	if (!lexer_.nextToken(source, lexToken, line_number))
+		return false;
+	instr = parseToken(lexToken);
+	return true;
+}
+
+t_Program Parser::parse(std::string_view source) const
+{
+	std::size_t	line_number = 0;
+	t_Program	instructions = parseLines(source, line_number);
+
+	instructions.shrink_to_fit();
+	return instructions;
+}
+
+t_Program Parser::parse(std::list<t_LexToken> &lexTokens) const
+{
+	t_Program	instructions;
+
+	instructions.reserve(lexTokens.size());
+	while (!lexTokens.empty())
+	{
+		instructions.push_back(parseToken(lexTokens.front()));
+		lexTokens.pop_front();
 	}
-	return parsTokens;
+	return instructions;
 }
 
-void Parser::cleanTokens(const std::list<t_ParsedInstr>& tokens)
+t_Program Parser::parse(std::vector<t_LexToken> const & lexTokens) const
+{
+	t_Program	instructions;
+
+	instructions.reserve(lexTokens.size());
+	for (t_LexToken const & lexToken : lexTokens)
+		instructions.push_back(parseToken(lexToken));
+	return instructions;
+}
+
+// Smallest part of the program worth a thread of its own
+static const std::size_t s_minChunkSize = 1 << 20;
+
+typedef struct s_Chunk
+{
+	std::string_view	source;
+	t_Program			instructions;
+	std::list<Error>	errors;
+	std::size_t			lines;
+	std::exception_ptr	failure;
+
+}	t_Chunk;
+
+// Splits the source in up to threads parts ending on a newline, parses them concurrently, then
+// shifts the line numbers of each part by the lines of the parts before it
+t_Program Parser::parse(std::string_view source, std::size_t threads) const
 {
-	for (const t_ParsedInstr& token : tokens)
-		if (token.operand != nullptr)
-			delete token.operand;
+	threads = std::min(threads, source.size() / s_minChunkSize + 1);
+	if (threads <= 1)
+		return parse(source);
+
+	std::vector<t_Chunk>	chunks;
+	std::size_t				target = source.size() / threads;
+
+	while (!source.empty())
+	{
+		std::size_t length = source.size();
+		if (chunks.size() + 1 < threads && target < length)
+		{
+			const char *newline = static_cast<const char *>(std::memchr(source.data() + target, '\n', length - target));
+			if (newline)
+				length = newline - source.data() + 1;
+		}
+		chunks.push_back(t_Chunk{source.substr(0, length), t_Program(), std::list<Error>(), 0, nullptr});
+		source.remove_prefix(length);
+	}
+
+	std::vector<std::thread> workers;
+	for (t_Chunk &chunk : chunks)
+		workers.emplace_back([this, &chunk]()
+		{
+			try
+			{
+				chunk.instructions = parseLines(chunk.source, chunk.lines);
+			}
+			catch (...)
+			{
+				chunk.failure = std::current_exception();
+			}
+			chunk.errors = AVMException::takeErrors();
+		});
+	for (std::thread &worker : workers)
+		worker.join();
+
+	std::size_t size = 0;
+	for (t_Chunk &chunk : chunks)
+	{
+		if (chunk.failure)
+			std::rethrow_exception(chunk.failure);
+		size += chunk.instructions.size();
+	}
+
+	t_Program	instructions;
+	std::size_t	lineOffset = 0;
+
+	instructions.reserve(size);
+	for (t_Chunk &chunk : chunks)
+	{
+		for (t_ParsedInstr &instr : chunk.instructions)
+		{
+			instr.line += lineOffset;
+			instructions.push_back(instr);
+		}
+		AVMException::mergeErrors(chunk.errors, lineOffset);
+		lineOffset += chunk.lines;
+	}
+	return instructions;
 }
@@ -0,0 +1,97 @@
+#include <sstream>
+#include <thread>
+#include "Pipeline.hpp"
+#include "Exceptions.hpp"
+#include "SpscRing.hpp"
+
+typedef std::vector<t_LexToken>	t_TokenBatch;
+
+// Large enough to amortize the hand-over, small enough for the executor to start early
+static const std::size_t	s_batchSize = 4096;
+static const std::size_t	s_ringSize = 16;
+
+typedef SpscRing<t_TokenBatch, s_ringSize>	t_TokenRing;
+typedef SpscRing<t_Program, s_ringSize>		t_InstructionRing;
+
+// Both stages end their output with an empty batch
+static void lexStage(Lexer const &lexer, std::string_view source, t_TokenRing &tokens, std::list<Error> &errors)
+{
+	t_TokenBatch	batch;
+	t_LexToken		token;
+	std::size_t		line_number = 0;
+
+	batch.reserve(s_batchSize);
+	while (lexer.nextToken(source, token, line_number))
+	{
+		batch.push_back(token);
+		if (batch.size() == s_batchSize)
+		{
+			tokens.push(std::move(batch));
+			batch = t_TokenBatch();
+			batch.reserve(s_batchSize);
+		}
+	}
+	if (!batch.empty())
+		tokens.push(std::move(batch));
+	tokens.push(t_TokenBatch());
+	errors = AVMException::takeErrors();
+}
+
+static void parseStage(Parser const &parser, t_TokenRing &tokens, t_InstructionRing &instructions,
+	std::list<Error> &errors)
+{
+	for (t_TokenBatch batch = tokens.pop(); !batch.empty(); batch = tokens.pop())
+		instructions.push(parser.parse(batch));
+	instructions.push(t_Program());
+	errors = AVMException::takeErrors();
+}
+
+bool Pipeline::run(Vm &vm, std::string_view source)
+{
+	t_TokenRing			tokens;
+	t_InstructionRing	instructions;
+	std::list<Error>	lexErrors;
+	std::list<Error>	parseErrors;
+	std::thread			lexer(lexStage, std::cref(vm.lexer()), source, std::ref(tokens), std::ref(lexErrors));
+	std::thread			parser(parseStage, std::cref(vm.parser()), std::ref(tokens), std::ref(instructions),
+		std::ref(parseErrors));
+
+	CommandsExecutor	&executor = vm.executor();
+	OutputBuffer		&output = executor.output();
+	std::ostringstream	err;
+	bool				running = true;
+
+	executor.setErrorStream(err);
+	output.hold();
+	std::size_t			lastLine = 0;
+
+	// Once the program is over, the remaining batches are only drained so the stages can finish
+	for (t_Program batch = instructions.pop(); !batch.empty(); batch = instructions.pop())
+	{
+		lastLine = batch.back().line;
+		for (std::size_t i = 0; running && i < batch.size(); ++i)
+			running = executor.executeNext(batch[i]);
+	}
+	lexer.join();
+	parser.join();
+	executor.setErrorStream(vm.errorStream());
+
+	if (!lexErrors.empty() || !parseErrors.empty())
+	{
+		// Without --pipeline the program would not have run at all
+		output.release(false);
+		AVMException::takeErrors();
+		AVMException::mergeErrors(lexErrors, 0);
+		AVMException::mergeErrors(parseErrors, 0);
+		vm.printErrors();
+		return false;
+	}
+	output.release(true);
+	vm.errorStream() << err.str();
+	if (running)
+	{
+		executor.endOfInput(lastLine);
+		return false;
+	}
+	return !vm.isError();
+}
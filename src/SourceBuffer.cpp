@@ -0,0 +1,96 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SourceBuffer.hpp"
+
+SourceBuffer::SourceBuffer(void) : data_(nullptr), size_(0), mapped_(false) {}
+
+SourceBuffer::~SourceBuffer(void)
+{
+	release();
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer const & rhs) {(void)rhs;}
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer const & rhs) {(void)rhs; return *this;}
+
+void SourceBuffer::release(void)
+{
+	if (mapped_)
+		munmap(const_cast<char *>(data_), size_);
+	data_ = nullptr;
+	size_ = 0;
+	mapped_ = false;
+	storage_.clear();
+}
+
+bool SourceBuffer::map(const char *path)
+{
+	struct stat	info;
+	int			fd = open(path, O_RDONLY);
+
+	release();
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	if (!S_ISREG(info.st_mode))
+	{
+		// Pipes and devices can't be mapped: read them whole instead
+		char	chunk[65536];
+		ssize_t	count;
+
+		while ((count = ::read(fd, chunk, sizeof(chunk))) > 0)
+			storage_.append(chunk, count);
+		data_ = storage_.data();
+		size_ = storage_.size();
+	}
+	else if (info.st_size > 0)
+	{
+		void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+		// The lexer reads the text once, front to back
+		madvise(data, info.st_size, MADV_SEQUENTIAL);
+		data_ = static_cast<const char *>(data);
+		size_ = info.st_size;
+		mapped_ = true;
+	}
+	close(fd);
+	return true;
+}
+
+// The ";;" line ends the program on the standard input and is not part of it
+void SourceBuffer::read(std::istream &input)
+{
+	std::string line;
+
+	release();
+	while (std::getline(input, line) && line != ";;")
+	{
+		storage_ += line;
+		storage_ += '\n';
+	}
+	data_ = storage_.data();
+	size_ = storage_.size();
+}
+
+void SourceBuffer::assign(std::string &&text)
+{
+	release();
+	storage_ = std::move(text);
+	data_ = storage_.data();
+	size_ = storage_.size();
+}
+
+std::string_view SourceBuffer::view(void) const
+{
+	return std::string_view(data_, size_);
+}
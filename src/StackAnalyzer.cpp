@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <functional>
+#include "StackAnalyzer.hpp"
+#include "Exceptions.hpp"
+
+void StackAnalyzer::reportUnderflow(t_ParsedInstr const & instr)
+{
+	static const char *arithNames[] = {"add", "sub", "mul", "div", "mod"};
+
+	if (instr.instruction == SWAP)
+	{
+		ImpossibleInstructionException e("swap");
+		e.pushError(instr.line);
+	}
+	else if (instr.instruction >= ADD && instr.instruction <= MOD)
+	{
+		ImpossibleInstructionException e(arithNames[instr.instruction - ADD]);
+		e.pushError(instr.line);
+	}
+	else
+	{
+		EmtpyStackException e;
+		e.pushError(instr.line);
+	}
+}
+
+// Runs before every native translation, so the stack of types is a plain array
+// indexed by hand: it is walked once per instruction, like the program itself
+std::size_t StackAnalyzer::analyze(t_Program &program)
+{
+	std::vector<e_OperandType>	slots(16);
+	e_OperandType				*types = slots.data(); // NoType once a slot's type depends on values
+	std::size_t					n = 0;
+	std::size_t					maxDepth = 0;
+	bool						quiet = true; // nothing so far could fail nor write output
+	t_ParsedInstr				*last = program.data() + program.size();
+
+	for (t_ParsedInstr *next = program.data(); next != last; ++next)
+	{
+		t_ParsedInstr &instr = *next;
+
+		if (n < requiredDepth(instr.instruction))
+		{
+			// Nothing before could stop the program, so it is sure to fail here
+			if (quiet)
+				reportUnderflow(instr);
+			break;
+		}
+		switch (instr.instruction)
+		{
+			case PUSH:
+				if (n == slots.size())
+				{
+					slots.resize(n * 2);
+					types = slots.data();
+				}
+				types[n++] = instr.operandType;
+				break;
+			case POP:
+				--n;
+				instr.instruction = POP_U;
+				break;
+			case SWAP:
+				std::swap(types[n - 1], types[n - 2]);
+				instr.instruction = SWAP_U;
+				break;
+			case ASSERT:
+				instr.instruction = ASSERT_U;
+				quiet = false;
+				break;
+			case PRINT:
+				if (types[n - 1] == Int8)
+					instr.instruction = PRINT_I8;
+				quiet = false;
+				break;
+			case DUMP:
+				// Even an empty stack is written out by the json and binary dump formats
+				quiet = false;
+				break;
+			case SORT:
+				if (std::adjacent_find(types, types + n, std::not_equal_to<e_OperandType>()) != types + n)
+					std::fill(types, types + n, NoType);
+				break;
+			case ADD: case SUB: case MUL: case DIV: case MOD:
+			{
+				e_OperandType lhs = types[n - 2];
+				e_OperandType rhs = types[n - 1];
+
+				--n;
+				if (lhs != NoType && rhs != NoType)
+				{
+					instr.variant = static_cast<uint8_t>(lhs * 5 + rhs);
+					instr.instruction = static_cast<e_Operation>(ADD_T + (instr.instruction - ADD));
+					types[n - 1] = std::max(lhs, rhs);
+				}
+				else
+					types[n - 1] = NoType;
+				quiet = false;
+				break;
+			}
+			default:
+				break;
+		}
+		if (n > maxDepth)
+			maxDepth = n;
+		if (instr.instruction == EXIT)
+			break;
+	}
+	return maxDepth;
+}
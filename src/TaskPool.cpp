@@ -0,0 +1,56 @@
+#include "TaskPool.hpp"
+
+TaskPool::TaskPool(std::size_t threads, std::size_t count, t_Task const & task)
+	: task_(task), threadCount_(threads == 0 ? 1 : threads), queues_(new t_Queue[threadCount_])
+{
+	for (std::size_t i = 0; i < count; ++i)
+		queues_[i % threadCount_].tasks.push_back(i);
+	threads_.reserve(threadCount_);
+	for (std::size_t self = 0; self < threadCount_; ++self)
+		threads_.emplace_back(&TaskPool::work, this, self);
+}
+
+TaskPool::~TaskPool(void)
+{
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+TaskPool::TaskPool(TaskPool const & rhs) : threadCount_(0) {(void)rhs;}
+
+TaskPool	&TaskPool::operator=(TaskPool const & rhs) {(void)rhs; return *this;}
+
+// No task adds tasks: once every deque is seen empty, there is nothing left to steal
+bool TaskPool::next(std::size_t self, std::size_t &task)
+{
+	{
+		std::lock_guard<std::mutex> lock(queues_[self].lock);
+		if (!queues_[self].tasks.empty())
+		{
+			task = queues_[self].tasks.front();
+			queues_[self].tasks.pop_front();
+			return true;
+		}
+	}
+	for (std::size_t i = 1; i < threadCount_; ++i)
+	{
+		t_Queue &victim = queues_[(self + i) % threadCount_];
+		std::lock_guard<std::mutex> lock(victim.lock);
+
+		if (!victim.tasks.empty())
+		{
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskPool::work(std::size_t self)
+{
+	std::size_t task;
+
+	while (next(self, task))
+		task_(task);
+}
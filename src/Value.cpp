@@ -0,0 +1,192 @@
+#include <charconv>
+#include <cmath>
+#include "Value.hpp"
+#include "Exceptions.hpp"
+
+static_assert(sizeof(Value) == 16, "Value must stay a 16-byte tagged value");
+
+Value::Value(void) : type_(NoType) {payload_.d = 0;}
+
+Value::Value(int8_t value) : type_(Int8) {payload_.d = 0; payload_.i8 = value;}
+
+Value::Value(int16_t value) : type_(Int16) {payload_.d = 0; payload_.i16 = value;}
+
+Value::Value(int32_t value) : type_(Int32) {payload_.d = 0; payload_.i32 = value;}
+
+Value::Value(float value) : type_(Float) {payload_.d = 0; payload_.f = value;}
+
+Value::Value(double value) : type_(Double) {payload_.d = value;}
+
+Value::Value(e_OperandType type, Payload payload) : type_(type), payload_(payload) {}
+
+e_OperandType Value::getType(void) const {return type_;}
+
+Payload Value::getPayload(void) const {return payload_;}
+
+int Value::getPrecision(void) const
+{
+	if (type_ == Float)
+		return std::numeric_limits<float>::digits10;
+	if (type_ == Double)
+		return std::numeric_limits<double>::digits10;
+	return 0;
+}
+
+std::string Value::toString(void) const
+{
+	char buffer[maxFormattedSize];
+
+	return std::string(buffer, format(buffer));
+}
+
+// Same text as an ostream set to getPrecision() digits: general format with that precision
+char *Value::format(char *first, bool roundTrip) const
+{
+	char *last = first + maxFormattedSize;
+
+	if (type_ < Float)
+		return std::to_chars(first, last, as<int32_t>()).ptr;
+	if (roundTrip)
+		return (type_ == Float ? std::to_chars(first, last, payload_.f) : std::to_chars(first, last, payload_.d)).ptr;
+	if (type_ == Float)
+		return std::to_chars(first, last, payload_.f, std::chars_format::general, getPrecision()).ptr;
+	return std::to_chars(first, last, payload_.d, std::chars_format::general, getPrecision()).ptr;
+}
+
+static e_OperandType promotedType(Value const & lhs, Value const & rhs)
+{
+	return (lhs.getType() >= rhs.getType() ? lhs.getType() : rhs.getType());
+}
+
+static const char *typeName(e_OperandType type)
+{
+	static const char *names[] = {"int8", "int16", "int32", "float", "double"};
+
+	return (type < NoType ? names[type] : "unknown");
+}
+
+void Value::outOfRange(int64_t value, e_OperandType type)
+{
+	if (value > 0)
+		throw OverflowException(std::to_string(value) + " is not " + typeName(type) + " type");
+	throw UnderflowException(std::to_string(value) + " is not " + typeName(type) + " type");
+}
+
+void Value::outOfRange(long double value, e_OperandType type)
+{
+	if (value > 0)
+		throw OverflowException(std::to_string(value) + " is not " + typeName(type) + " type");
+	throw UnderflowException(std::to_string(value) + " is not " + typeName(type) + " type");
+}
+
+// Integer results are computed in int64_t, which holds any int32 sum or product exactly
+static Value result(e_OperandType type, int64_t value)
+{
+	switch (type)
+	{
+		case Int8:
+			return Value::narrow<int8_t>(value);
+		case Int16:
+			return Value::narrow<int16_t>(value);
+		default:
+			return Value::narrow<int32_t>(value);
+	}
+}
+
+// Floating results are computed in long double, so a double overflow is still detectable
+static Value result(e_OperandType type, long double value)
+{
+	if (type == Float)
+		return Value::narrow<float>(value);
+	return Value::narrow<double>(value);
+}
+
+Value Value::operator+(Value const & rhs) const
+{
+	e_OperandType e = promotedType(*this, rhs);
+
+	if (e < Float)
+		return result(e, as<int64_t>() + rhs.as<int64_t>());
+	return result(e, as<long double>() + rhs.as<long double>());
+}
+
+Value Value::operator-(Value const & rhs) const
+{
+	e_OperandType e = promotedType(*this, rhs);
+
+	if (e < Float)
+		return result(e, as<int64_t>() - rhs.as<int64_t>());
+	return result(e, as<long double>() - rhs.as<long double>());
+}
+
+Value Value::operator*(Value const & rhs) const
+{
+	e_OperandType e = promotedType(*this, rhs);
+
+	if (e < Float)
+		return result(e, as<int64_t>() * rhs.as<int64_t>());
+	return result(e, as<long double>() * rhs.as<long double>());
+}
+
+Value Value::operator/(Value const & rhs) const
+{
+	e_OperandType e = promotedType(*this, rhs);
+
+	if (e < Float)
+	{
+		int64_t divisor = rhs.as<int64_t>();
+		if (divisor == 0)
+			throw DivModByZeroException();
+		return result(e, as<int64_t>() / divisor);
+	}
+	long double divisor = rhs.as<long double>();
+	if (divisor == 0)
+		throw DivModByZeroException();
+	return result(e, as<long double>() / divisor);
+}
+
+Value Value::operator%(Value const & rhs) const
+{
+	e_OperandType e = promotedType(*this, rhs);
+
+	if (e < Float)
+	{
+		int64_t divisor = rhs.as<int64_t>();
+		if (divisor == 0)
+			throw DivModByZeroException();
+		return result(e, as<int64_t>() % divisor);
+	}
+	long double divisor = rhs.as<long double>();
+	if (divisor == 0)
+		throw DivModByZeroException();
+	return result(e, std::fmod(as<long double>(), divisor));
+}
+
+bool Value::operator==(Value const & rhs) const
+{
+	e_OperandType e = promotedType(*this, rhs);
+
+	if (e < Float)
+		return (as<int64_t>() == rhs.as<int64_t>());
+	else if (e == Float)
+		return (as<float>() == rhs.as<float>());
+	else
+		return (as<double>() == rhs.as<double>());
+}
+
+bool Value::operator<(Value const & rhs) const
+{
+	e_OperandType e = promotedType(*this, rhs);
+
+	if (e < Float)
+		return (as<int64_t>() < rhs.as<int64_t>());
+	else if (e == Float)
+		return (as<float>() < rhs.as<float>());
+	else
+		return (as<double>() < rhs.as<double>());
+}
+
+bool Value::operator>(Value const & rhs) const
+{
+	return (rhs < *this);
+}
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include "Vm.hpp"
+#include "Bytecode.hpp"
+#include "CppEmitter.hpp"
+#include "InstructionFuser.hpp"
+#include "Jit.hpp"
+#include "Optimizer.hpp"
+#include "StackAnalyzer.hpp"
+
+#ifdef DEBUG
+static void printTokens(const std::list<t_LexToken>& tokens)
+{
+	int nb = 1;
+	std::cout << "##### Lexer output #####" << std::endl;
+	std::cout << "------------------------" << std::endl;
+	for (const t_LexToken& token : tokens)
+	{
+		std::cout << nb++ << ":\n";
+		std::cout << "  instruction: " << token.instruction << std::endl;
+		std::cout << "  operandType: " << (token.operandType.empty() ? "<none>" : token.operandType) << std::endl;
+		std::cout << "  literal:     " << (token.literal.empty() ? "<none>" : token.literal) << std::endl;
+		std::cout << "------------------------" << std::endl;
+	}
+}
+
+static void printTokens(const t_Program& tokens)
+{
+	int nb = 1;
+	std::cout << "##### Parser output #####" << std::endl;
+	std::cout << "-------------------------" << std::endl;
+	for (const t_ParsedInstr& token : tokens)
+	{
+		std::cout << nb++ << ":\n";
+		std::cout << "  instruction: " << static_cast<int>(token.instruction) << std::endl;
+		std::cout << "  operandType: " << static_cast<int>(token.operandType) << std::endl;
+		std::cout << "  operand:     " << (token.operandType == NoType ? "<none>" : Value(token.operandType, token.operand).toString()) << std::endl;
+		std::cout << "-------------------------" << std::endl;
+	}
+}
+#endif
+
+Vm::Vm(int output, std::ostream &errors, std::ostream &messages)
+	: parser_(lexer_, factory_), errorStream_(errors), messageStream_(messages), executor_(output, errors) {}
+
+Vm::~Vm(void) {}
+
+Vm::Vm(Vm const & rhs) : parser_(lexer_, factory_), errorStream_(rhs.errorStream_),
+	messageStream_(rhs.messageStream_), executor_(STDOUT_FILENO, rhs.errorStream_) {}
+
+Vm	&Vm::operator=(Vm const & rhs) {(void)rhs; return *this;}
+
+Vm::Scope::Scope(Vm &vm) : previous_(AVMException::collectErrors(&vm.errors_)) {}
+
+Vm::Scope::~Scope(void)
+{
+	AVMException::collectErrors(previous_);
+}
+
+Vm::Scope::Scope(Scope const & rhs) : previous_(rhs.previous_) {}
+
+Vm::Scope	&Vm::Scope::operator=(Scope const & rhs) {(void)rhs; return *this;}
+
+void Vm::printErrors(void)
+{
+	AVMException::printErrors(errorStream_);
+}
+
+bool Vm::load(std::string_view source, const char *name, t_Program &program, std::size_t parseThreads)
+{
+	if (Bytecode::isBytecode(source))
+	{
+		std::string error;
+		if (Bytecode::load(source, name, program, error))
+			return true;
+		messageStream_ << "Error: " << error << std::endl;
+		return false;
+	}
+#ifdef DEBUG
+	(void)parseThreads;
+	std::list<t_LexToken> lexTokens = lexer_.lexicalAnalisys(source);
+	printTokens(lexTokens);
+	std::cout << std::endl;
+	program = parser_.parse(lexTokens);
+	printTokens(program);
+	std::cout << std::endl << "##### Program output #####" << std::endl << std::endl;
+#else
+	program = parser_.parse(source, parseThreads);
+#endif
+	if (!isError())
+		return true;
+	printErrors();
+	return false;
+}
+
+bool Vm::reserveStack(std::size_t values)
+{
+	try
+	{
+		executor_.reserve(values);
+	}
+	catch (const std::exception&)
+	{
+		messageStream_ << "Error: could not reserve " << values << " stack values." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Vm::run(t_Program &program, bool optimize, bool jit, std::size_t stackReserve)
+{
+	if (optimize)
+		Optimizer::optimize(program);
+	// Too long to pay for its translation, nor for the analysis it would need
+	if (program.size() > Jit::maxInstructions)
+		jit = false;
+	// The native backend needs the depth of the stack before every instruction
+	if (optimize || jit)
+	{
+		stackReserve = std::max(stackReserve, StackAnalyzer::analyze(program));
+		if (isError())
+		{
+			printErrors();
+			return false;
+		}
+	}
+	if (!reserveStack(stackReserve))
+		return false;
+	Jit native;
+	if (jit && native.compile(program))
+		executor_.execute(program, native);
+	else
+	{
+		InstructionFuser::fuse(program);
+		executor_.execute(program);
+	}
+	return !isError();
+}
+
+bool Vm::compile(t_Program &program, bool optimize, const char *path)
+{
+	std::string error;
+
+	if (optimize)
+		Optimizer::optimize(program);
+	if (Bytecode::write(program, path, error))
+		return true;
+	messageStream_ << "Error: " << error << std::endl;
+	return false;
+}
+
+// The generated code relies on the depth and types of the stack at every instruction
+bool Vm::emitCpp(t_Program &program, bool optimize, const char *name, const char *path)
+{
+	std::string error;
+
+	if (optimize)
+		Optimizer::optimize(program);
+	StackAnalyzer::analyze(program);
+	if (isError())
+	{
+		printErrors();
+		return false;
+	}
+	if (CppEmitter::write(program, name, path, error))
+		return true;
+	messageStream_ << "Error: " << error << std::endl;
+	return false;
+}
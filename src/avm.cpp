@@ -0,0 +1,123 @@
+#include <memory>
+#include <new>
+#include <sstream>
+#include "avm.h"
+#include "Vm.hpp"
+
+// Every call collects the errors of the calling thread into the machine, and no exception
+// crosses into C
+struct s_Avm
+{
+	int					flags;
+	std::ostringstream	errors;
+	std::string			errorText;
+	std::string			output;
+	t_Program			program;
+	std::unique_ptr<Vm>	vm;
+	bool				loaded;
+};
+
+static void reset(t_Avm *avm)
+{
+	avm->vm.reset();
+	avm->errors.str("");
+	avm->errorText.clear();
+	avm->output.clear();
+	avm->loaded = false;
+	avm->vm.reset(new Vm(STDOUT_FILENO, avm->errors, avm->errors));
+	avm->vm->executor().output().hold();
+	if (avm->flags & AVM_DUMP_JSON)
+		avm->vm->executor().setDumpFormat(DumpJson);
+	else if (avm->flags & AVM_DUMP_BINARY)
+		avm->vm->executor().setDumpFormat(DumpBinary);
+}
+
+t_Avm *avm_create(int flags)
+{
+	std::unique_ptr<t_Avm> avm(new (std::nothrow) t_Avm());
+
+	if (!avm)
+		return nullptr;
+	avm->flags = flags;
+	try
+	{
+		reset(avm.get());
+	}
+	catch (std::exception const &)
+	{
+		return nullptr;
+	}
+	return avm.release();
+}
+
+void avm_destroy(t_Avm *avm)
+{
+	delete avm;
+}
+
+int avm_load(t_Avm *avm, const char *program, size_t size)
+{
+	try
+	{
+		reset(avm);
+		Vm::Scope scope(*avm->vm);
+		avm->loaded = avm->vm->load(std::string_view(program, size), "the program", avm->program);
+	}
+	catch (std::exception const & e)
+	{
+		avm->errors << "Error: " << e.what() << std::endl;
+	}
+	avm->errorText = avm->errors.str();
+	return avm->loaded ? 0 : -1;
+}
+
+int avm_run(t_Avm *avm)
+{
+	bool succeeded = false;
+
+	if (!avm->loaded)
+		return -1;
+	avm->loaded = false;
+	try
+	{
+		Vm::Scope scope(*avm->vm);
+		succeeded = avm->vm->run(avm->program, avm->flags & AVM_OPTIMIZE, avm->flags & AVM_JIT);
+	}
+	catch (std::exception const & e)
+	{
+		avm->errors << "Error: " << e.what() << std::endl;
+		succeeded = false;
+	}
+	avm->vm->executor().output().release(avm->output);
+	avm->errorText = avm->errors.str();
+	return succeeded ? 0 : -1;
+}
+
+const char *avm_output(t_Avm const *avm, size_t *size)
+{
+	*size = avm->output.size();
+	return avm->output.data();
+}
+
+const char *avm_errors(t_Avm const *avm)
+{
+	return avm->errorText.c_str();
+}
+
+// A load that ran out of memory may have left no machine
+size_t avm_stack_size(t_Avm const *avm)
+{
+	return avm->vm ? avm->vm->stack().size() : 0;
+}
+
+int avm_stack_value(t_Avm const *avm, size_t index, t_AvmValue *value)
+{
+	if (index >= avm_stack_size(avm))
+		return -1;
+
+	OperandStack const &stack = avm->vm->stack();
+	Value top = stack.at(stack.size() - 1 - index);
+	value->type = static_cast<t_AvmType>(top.getType());
+	value->value = top.as<double>();
+	return 0;
+}
@@ -1,86 +1,503 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
-#include "OperandFactory.hpp"
-#include "Operand.hpp"
-#include "Lexer.hpp"
-#include "Parser.hpp"
-#include "CommandsExecutor.hpp"
+#include <thread>
+#include "Bytecode.hpp"
+#include "SourceBuffer.hpp"
+#include "Pipeline.hpp"
+#include "Vm.hpp"
+#include "Batch.hpp"
+#include "Daemon.hpp"
 
-#ifdef DEBUG
-void printTokens(const std::list<t_LexToken>& tokens)
+typedef struct s_Options
 {
-	int nb = 1;
-	std::cout << "##### Lexer output #####" << std::endl;
-	std::cout << "------------------------" << std::endl;
-	for (const t_LexToken& token : tokens)
+	const char		*file;
+	const char		*output;
+	bool			compile;
+	bool			emitCpp;
+	bool			optimize;
+	bool			jit;
+	bool			stream;
+	bool			pipeline;
+	std::size_t		stackReserve;
+	std::size_t		parseThreads;
+	const char		*flush;
+	bool			asyncOutput;
+	e_DumpFormat	dumpFormat;
+	std::string		defaultOutput;
+	bool			batch;
+	std::size_t		jobs;
+	bool			multi;
+	const char		*serve;
+	const char		*client;
+	std::vector<std::string>	files;
+
+}	t_Options;
+
+static t_Options defaultOptions(void)
+{
+	return {nullptr, nullptr, false, false, false, false, false, false, 0, 1, nullptr, false, DumpText, "",
+		false, 0, false, nullptr, nullptr, {}};
+}
+
+static void printUsage(void)
+{
+	std::cout << "Usage: ./avm [-O0 | -O1] [--jit] [--stack-reserve N] [--parse-threads N] [--flush=line|full|exit] [--async-output] [--dump-format=text|json|binary] [file | file.avmc]" << std::endl;
+	std::cout << "       ./avm --batch [--jobs N] [-O0 | -O1] [--jit] [--stack-reserve N] [--dump-format=text|json|binary] [--manifest list] file..." << std::endl;
+	std::cout << "       ./avm --multi [-O0 | -O1] [--jit] [--stack-reserve N] [--dump-format=text|json|binary]" << std::endl;
+	std::cout << "       ./avm --serve socket [--jobs N]" << std::endl;
+	std::cout << "       ./avm --client socket [-O0 | -O1] [--jit] [--stack-reserve N] [--dump-format=text|json|binary] [file | file.avmc]" << std::endl;
+	std::cout << "       ./avm --pipeline [--stack-reserve N] [file | file.avmc]" << std::endl;
+	std::cout << "       ./avm --stream [--stack-reserve N] [file]" << std::endl;
+	std::cout << "       ./avm --compile [-O0 | -O1] [file] [-o file.avmc]" << std::endl;
+	std::cout << "       ./avm --emit-cpp [-O0 | -O1] [file | file.avmc] [-o file.cpp]" << std::endl;
+}
+
+static bool parseSize(const char *str, std::size_t &size)
+{
+	std::string value(str);
+
+	if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	try
+	{
+		size = std::stoull(value);
+	}
+	catch (const std::exception&)
 	{
-		std::cout << nb++ << ":\n";
-		std::cout << "  instruction: " << token.instruction << std::endl;
-		std::cout << "  operandType: " << (token.operandType.empty() ? "<none>" : token.operandType) << std::endl;
-		std::cout << "  literal:     " << (token.literal.empty() ? "<none>" : token.literal) << std::endl;
-		std::cout << "------------------------" << std::endl;
+		return false;
 	}
+	return true;
+}
+
+static bool toFlushPolicy(std::string const & name, e_FlushPolicy &policy)
+{
+	if (name == "line")
+		policy = FlushLine;
+	else if (name == "full")
+		policy = FlushFull;
+	else if (name == "exit")
+		policy = FlushExit;
+	else
+		return false;
+	return true;
 }
 
-void printTokens(const std::list<t_ParsedInstr>& tokens)
+static bool toDumpFormat(std::string const & name, e_DumpFormat &format)
 {
-	int nb = 1;
-	std::cout << "##### Parser output #####" << std::endl;
-	std::cout << "-------------------------" << std::endl;
-	for (const t_ParsedInstr& token : tokens)
+	if (name == "text")
+		format = DumpText;
+	else if (name == "json")
+		format = DumpJson;
+	else if (name == "binary")
+		format = DumpBinary;
+	else
+		return false;
+	return true;
+}
+
+static bool checkBatchOptions(t_Options &options)
+{
+	if (options.compile || options.emitCpp || options.stream || options.pipeline || options.parseThreads > 1
+		|| options.flush != nullptr || options.asyncOutput || options.output != nullptr)
+	{
+		std::cout << "Error: --batch keeps the output of each program in memory and can't be used with --compile, --emit-cpp, --stream, --pipeline, --parse-threads, --flush, --async-output or -o." << std::endl;
+		return false;
+	}
+	if (options.files.empty())
 	{
-		std::cout << nb++ << ":\n";
-		std::cout << "  instruction: " << token.instruction << std::endl;
-		std::cout << "  operandType: " << token.operandType << std::endl;
-		std::cout << "  operand:     " << (token.operand == nullptr ? "<none>" : token.operand->toString()) << std::endl;
-		std::cout << "-------------------------" << std::endl;
+		std::cout << "Error: --batch expects program files." << std::endl;
+		return false;
 	}
+	if (options.jobs == 0)
+		options.jobs = std::max(1u, std::thread::hardware_concurrency());
+	return true;
 }
-#endif
 
-int main(int argc, char **argv)
+// The server runs programs with the options each client sends along
+static bool checkServeOptions(t_Options &options, bool manifest)
+{
+	if (!options.files.empty() || options.output != nullptr || options.compile || options.emitCpp || options.optimize
+		|| options.jit || options.stream || options.pipeline || options.stackReserve != 0 || options.parseThreads > 1
+		|| options.flush != nullptr || options.asyncOutput || options.dumpFormat != DumpText || options.batch
+		|| options.multi || options.client != nullptr || manifest)
+	{
+		std::cout << "Error: --serve only takes --jobs, clients send the options of each program." << std::endl;
+		return false;
+	}
+	if (options.jobs == 0)
+		options.jobs = std::max(1u, std::thread::hardware_concurrency());
+	return true;
+}
+
+static bool parseOptions(int argc, char **argv, t_Options &options)
 {
-	std::istream* input = &std::cin;
-	std::ifstream inFile;
+	bool manifest = false;
 
-	if (argc > 2)
+	for (int i = 1; i < argc; ++i)
 	{
-		std::cout << "Usage: ./avm [file]" << std::endl;
-		return 1;
+		std::string arg(argv[i]);
+
+		if (arg == "--stack-reserve")
+		{
+			if (i + 1 >= argc || !parseSize(argv[++i], options.stackReserve))
+			{
+				std::cout << "Error: --stack-reserve expects a number of values." << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--parse-threads")
+		{
+			if (i + 1 >= argc || !parseSize(argv[++i], options.parseThreads) || options.parseThreads == 0)
+			{
+				std::cout << "Error: --parse-threads expects a positive number of threads." << std::endl;
+				return false;
+			}
+		}
+		else if (arg.compare(0, 8, "--flush=") == 0)
+		{
+			e_FlushPolicy policy;
+			options.flush = argv[i] + 8;
+			if (!toFlushPolicy(options.flush, policy))
+			{
+				std::cout << "Error: --flush expects line, full or exit." << std::endl;
+				return false;
+			}
+		}
+		else if (arg.compare(0, 14, "--dump-format=") == 0)
+		{
+			if (!toDumpFormat(arg.substr(14), options.dumpFormat))
+			{
+				std::cout << "Error: --dump-format expects text, json or binary." << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--jobs")
+		{
+			if (i + 1 >= argc || !parseSize(argv[++i], options.jobs) || options.jobs == 0)
+			{
+				std::cout << "Error: --jobs expects a positive number of threads." << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--manifest")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cout << "Error: --manifest expects a file listing programs." << std::endl;
+				return false;
+			}
+			if (!Batch::readManifest(argv[++i], options.files))
+			{
+				std::cout << "Error: could not open manifest " << argv[i] << std::endl;
+				return false;
+			}
+			manifest = true;
+		}
+		else if (arg == "--batch")
+			options.batch = true;
+		else if (arg == "--multi")
+			options.multi = true;
+		else if (arg == "--serve" || arg == "--client")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cout << "Error: " << arg << " expects a socket path." << std::endl;
+				return false;
+			}
+			(arg == "--serve" ? options.serve : options.client) = argv[++i];
+		}
+		else if (arg == "--async-output")
+			options.asyncOutput = true;
+		else if (arg == "--compile")
+			options.compile = true;
+		else if (arg == "--emit-cpp")
+			options.emitCpp = true;
+		else if (arg == "-O0" || arg == "-O1")
+			options.optimize = (arg == "-O1");
+		else if (arg == "--jit")
+			options.jit = true;
+		else if (arg == "--stream")
+			options.stream = true;
+		else if (arg == "--pipeline")
+			options.pipeline = true;
+		else if (arg == "-o")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cout << "Error: -o expects an output file." << std::endl;
+				return false;
+			}
+			options.output = argv[++i];
+		}
+		else if (arg.empty() || arg[0] != '-' || arg.size() == 1)
+			options.files.push_back(arg);
+		else
+		{
+			printUsage();
+			return false;
+		}
+	}
+	if (options.serve != nullptr)
+		return checkServeOptions(options, manifest);
+	if (options.batch && options.multi)
+	{
+		std::cout << "Error: --batch and --multi can't be used together." << std::endl;
+		return false;
+	}
+	if (options.batch)
+		return checkBatchOptions(options);
+	if (options.jobs != 0 || manifest)
+	{
+		std::cout << "Error: --jobs only applies to --batch and --serve, --manifest to --batch." << std::endl;
+		return false;
+	}
+	if (options.client != nullptr && (options.compile || options.emitCpp || options.stream || options.pipeline
+		|| options.parseThreads > 1 || options.flush != nullptr || options.asyncOutput || options.output != nullptr || options.multi))
+	{
+		std::cout << "Error: --client runs the program on the server and can't be used with --compile, --emit-cpp, --stream, --pipeline, --parse-threads, --flush, --async-output, -o or --multi." << std::endl;
+		return false;
+	}
+	if (options.multi && (!options.files.empty() || options.compile || options.emitCpp || options.stream || options.pipeline
+		|| options.parseThreads > 1 || options.flush != nullptr || options.asyncOutput || options.output != nullptr))
+	{
+		std::cout << "Error: --multi runs the programs of the standard input one by one and can't be used with a file, --compile, --emit-cpp, --stream, --pipeline, --parse-threads, --flush, --async-output or -o." << std::endl;
+		return false;
+	}
+	if (options.files.size() > 1)
+	{
+		printUsage();
+		return false;
+	}
+	if (!options.files.empty())
+		options.file = options.files[0].c_str();
+	if (options.compile && options.emitCpp)
+	{
+		std::cout << "Error: --compile and --emit-cpp can't be used together." << std::endl;
+		return false;
+	}
+	if (options.stream && (options.compile || options.emitCpp || options.optimize || options.jit || options.parseThreads > 1))
+	{
+		std::cout << "Error: --stream runs instructions as they are read and can't be used with --compile, --emit-cpp, -O1, --jit or --parse-threads." << std::endl;
+		return false;
+	}
+	if (options.pipeline && (options.compile || options.emitCpp || options.optimize || options.jit || options.stream || options.parseThreads > 1))
+	{
+		std::cout << "Error: --pipeline runs instructions while they are parsed and can't be used with --compile, --emit-cpp, -O1, --jit, --stream or --parse-threads." << std::endl;
+		return false;
+	}
+	if ((options.compile || options.emitCpp) && options.output == nullptr)
+	{
+		const char *flag = options.compile ? "--compile" : "--emit-cpp";
+
+		if (options.file == nullptr)
+		{
+			std::cout << "Error: " << flag << " from the standard input needs -o." << std::endl;
+			return false;
+		}
+		options.defaultOutput = options.file;
+		bool avmSource = options.defaultOutput.size() > 4 && options.defaultOutput.compare(options.defaultOutput.size() - 4, 4, ".avm") == 0;
+		if (options.compile)
+			options.defaultOutput += avmSource ? "c" : ".avmc";
+		else if (avmSource)
+			options.defaultOutput.replace(options.defaultOutput.size() - 4, 4, ".cpp");
+		else
+			options.defaultOutput += ".cpp";
+		options.output = options.defaultOutput.c_str();
 	}
-	if (argc == 2)
+	return true;
+}
+
+static bool readSource(const char *file, SourceBuffer &source, std::ostream &out)
+{
+	if (file == nullptr)
+		source.read(std::cin);
+	else if (std::string(file).empty())
+	{
+		out << "Error: file argument must not be empty." << std::endl;
+		return false;
+	}
+	else if (!source.map(file))
 	{
-		if (std::string(argv[1]).empty())
+		out << "Error: could not open file " << file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Runs every instruction as soon as it is read, so memory does not grow with the program.
+// A parsing error stops the execution but the rest of the input is still parsed, so every
+// parsing error is reported as usual; exit or an execution error ends the program right away
+static int streamProgram(Vm &vm, t_Options const & options)
+{
+	std::ifstream	file;
+	std::istream	*input = &std::cin;
+
+	if (options.file != nullptr)
+	{
+		if (std::string(options.file).empty())
 		{
 			std::cout << "Error: file argument must not be empty." << std::endl;
 			return 1;
 		}
-		inFile.open(argv[1]);
-		if (!inFile.is_open())
+		file.open(options.file, std::ios::binary);
+		if (!file)
 		{
-			std::cout << "Error: could not open file " << argv[1] << std::endl;
+			std::cout << "Error: could not open file " << options.file << std::endl;
 			return 1;
 		}
-		input = &inFile;
-	}
-
-	std::list<t_LexToken> lexTokens = Lexer::getInstance().lexicalAnalisys(input);
-	std::list<t_ParsedInstr> parstokens = Parser::getInstance().parse(lexTokens);
-#ifdef DEBUG
-	printTokens(lexTokens);
-	std::cout << std::endl;
-	printTokens(parstokens);
-	std::cout << std::endl << "##### Program output #####" << std::endl << std::endl;
-#endif
-	if (AVMException::isError())
-		AVMException::printErrors();
-	else
-		CommandsExecutor::getInstance().execute(parstokens);
-	Parser::cleanTokens(parstokens);
-	if (inFile.is_open())
-		inFile.close();
-	if (AVMException::isError())
+		input = &file;
+	}
+
+	std::string		line;
+	std::size_t		line_number = 0;
+	std::size_t		last_line = 0;
+	t_ParsedInstr	instr;
+
+	while (std::getline(*input, line) && (options.file != nullptr || line != ";;"))
+	{
+		if (line_number == 0 && Bytecode::isBytecode(line))
+		{
+			std::cout << "Error: --stream runs source programs, not bytecode." << std::endl;
+			return 1;
+		}
+		line += '\n';
+		std::string_view source(line);
+		if (!vm.parser().parseNext(source, line_number, instr))
+			continue;
+		last_line = instr.line;
+		if (!vm.isError() && !vm.executor().executeNext(instr))
+			return vm.isError() ? 1 : 0;
+	}
+	if (vm.isError())
+	{
+		vm.printErrors();
 		return 1;
-	else
-		return 0;
+	}
+	vm.executor().endOfInput(last_line);
+	return 1;
+}
+
+// A program from its file or the standard input: avm's own messages go to out. A source
+// program is parsed while it runs with --pipeline
+static int runProgram(Vm &vm, t_Options const & options, const char *file, std::ostream &out)
+{
+	const char	*name = file != nullptr ? file : "the standard input";
+	SourceBuffer	source;
+	t_Program	program;
+
+	if (!readSource(file, source, out))
+		return 1;
+	if (options.pipeline && !Bytecode::isBytecode(source.view()))
+		return vm.reserveStack(options.stackReserve) && Pipeline::run(vm, source.view()) ? 0 : 1;
+	if (!vm.load(source.view(), name, program, options.parseThreads))
+		return 1;
+	if (options.compile)
+		return vm.compile(program, options.optimize, options.output) ? 0 : 1;
+	if (options.emitCpp)
+		return vm.emitCpp(program, options.optimize, name, options.output) ? 0 : 1;
+	return vm.run(program, options.optimize, options.jit, options.stackReserve) ? 0 : 1;
+}
+
+static Batch::t_Runner programRunner(t_Options const & options)
+{
+	return [&options](Vm &vm, const char *file, std::ostream &out)
+	{
+		vm.executor().setDumpFormat(options.dumpFormat);
+		return runProgram(vm, options, file, out);
+	};
+}
+
+// Runs each ";;"-terminated program of the standard input in a fresh Vm as soon as it is read,
+// then writes its result as one frame: a header line with the program's number, exit status
+// and output and error sizes in bytes, followed by its output and its errors
+static int multiPrograms(t_Options const & options)
+{
+	Batch::t_Runner	runner = programRunner(options);
+	int				status = 0;
+
+	// Whitespace after a program is not another one: lines count from a program's first
+	// non-blank line
+	for (std::size_t count = 1; (std::cin >> std::ws).peek() != std::char_traits<char>::eof(); ++count)
+	{
+		Batch::t_Result result;
+
+		Batch::runProgram(nullptr, runner, result);
+		std::cout << "program " << count << " status " << result.status << " stdout " << result.output.size()
+			<< " stderr " << result.errors.size() << '\n';
+		std::cout.write(result.output.data(), result.output.size());
+		std::cout.write(result.errors.data(), result.errors.size()).flush();
+		if (result.status != 0)
+			status = 1;
+	}
+	return status;
+}
+
+// Runs a program received by the server, with the options its client was given
+static int serveRequest(Vm &vm, Daemon::t_Request &request, std::ostream &out)
+{
+	const char	*name = request.file.empty() ? "the standard input" : request.file.c_str();
+	t_Program	program;
+
+	(void)out;
+	vm.executor().setDumpFormat(request.dumpFormat);
+	if (!vm.load(request.program, name, program))
+		return 1;
+	return vm.run(program, request.optimize, request.jit, request.stackReserve) ? 0 : 1;
+}
+
+// Sends the program to the server instead of running it, then prints what it would have printed
+static int clientProgram(t_Options const & options)
+{
+	Daemon::t_Request	request = {options.optimize, options.jit, options.dumpFormat, options.stackReserve, "", ""};
+	SourceBuffer		source;
+	Batch::t_Result		result;
+	std::string			error;
+
+	if (!readSource(options.file, source, std::cout))
+		return 1;
+	if (options.file != nullptr)
+		request.file = options.file;
+	request.program.assign(source.view());
+	if (!Daemon::request(options.client, request, result, error))
+	{
+		std::cout << "Error: " << error << std::endl;
+		return 1;
+	}
+	std::cout.write(result.output.data(), result.output.size()).flush();
+	std::cerr << result.errors;
+	return result.status;
+}
+
+int main(int argc, char **argv)
+{
+	t_Options options = defaultOptions();
+
+	if (!parseOptions(argc, argv, options))
+		return 1;
+	if (options.batch)
+		return Batch::run(options.files, options.jobs, programRunner(options));
+	if (options.multi)
+		return multiPrograms(options);
+	if (options.serve != nullptr)
+	{
+		std::string error;
+		Daemon::serve(options.serve, options.jobs, serveRequest, error);
+		std::cout << "Error: " << error << std::endl;
+		return 1;
+	}
+	if (options.client != nullptr)
+		return clientProgram(options);
+
+	Vm vm;
+	Vm::Scope scope(vm);
+	e_FlushPolicy policy;
+	if (options.flush != nullptr && toFlushPolicy(options.flush, policy))
+		vm.executor().output().setPolicy(policy);
+	if (options.asyncOutput)
+		vm.executor().output().startWriter();
+	vm.executor().setDumpFormat(options.dumpFormat);
+	if (options.stream)
+		return vm.reserveStack(options.stackReserve) ? streamProgram(vm, options) : 1;
+	return runProgram(vm, options, options.file, std::cout);
 }
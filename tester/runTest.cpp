@@ -4,11 +4,14 @@
 #include <fstream>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
 #include <stdexcept>
 #include <algorithm>
 #include <sstream>
 #include <vector>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "Tester.hpp"
 
@@ -18,7 +21,7 @@ struct AVMResult
 	std::string stderrStr;
 };
 
-AVMResult exec(const std::string& cmd)
+AVMResult exec(const std::string& cmd, const std::string& args = "")
 {
 	std::string safeCmd;
 	for (char c : cmd)
@@ -29,7 +32,7 @@ AVMResult exec(const std::string& cmd)
 			safeCmd += c;
 	}
 	std::string tmpErrFile = "/tmp/avm_stderr.txt";
-	std::string fullCmd = "printf \"" + safeCmd + "\" | ./avm" + " 2> " + tmpErrFile;
+	std::string fullCmd = "(printf \"" + safeCmd + "\" | ./avm" + args + ") 2> " + tmpErrFile;
 
 	std::array<char, 128> buffer;
 	std::string out;
@@ -67,10 +70,17 @@ void AssertResult(std::string command, std::string result)
 	Tester::assertExpectedEqualsActual(std::string(""), res.stderrStr);
 }
 
+void AssertResultWith(const std::string& args, std::string command, std::string result)
+{
+	AVMResult res = exec(command, args);
+	Tester::assertExpectedEqualsActual(result, res.stdoutStr);
+	Tester::assertExpectedEqualsActual(std::string(""), res.stderrStr);
+}
+
 template<typename... Args>
-void AssertError(const std::string& command, Args... expectedLines)
+void AssertErrorWith(const std::string& args, const std::string& command, Args... expectedLines)
 {
-	AVMResult res = exec(command);
+	AVMResult res = exec(command, args);
 
 	std::string stderrLower = res.stderrStr;
 	std::transform(stderrLower.begin(), stderrLower.end(), stderrLower.begin(), ::tolower);
@@ -106,6 +116,12 @@ void AssertError(const std::string& command, Args... expectedLines)
 	Tester::assertExpectedEqualsActual(std::string(""), res.stdoutStr);
 }
 
+template<typename... Args>
+void AssertError(const std::string& command, Args... expectedLines)
+{
+	AssertErrorWith("", command, expectedLines...);
+}
+
 void AssertBoth(std::string command, std::string std, std::string err)
 {
 	AVMResult res = exec(command);
@@ -221,11 +237,18 @@ void push_test()
 	// Underflow int8
 	AssertError("push int8(-129)\nexit\n", "underflow");
 
+	// Literals beyond 64 bits keep their sign
+	AssertError("push int32(99999999999999999999)\nexit\n", "overflow --> 99999999999999999999 is not int32 type");
+	AssertError("push int32(-99999999999999999999)\nexit\n", "underflow --> -99999999999999999999 is not int32 type");
+	AssertError("push double(-1e999)\nexit\n", "underflow --> -1e999 is not double type");
+
 	// Invalid integer format
 	AssertError("push int32(abc)\nexit\n", "value format");
 
 	// Invalid float format
 	AssertError("push float(3.14.15)\nexit\n", "value format");
+	AssertError("push double(.e5)\nexit\n", "value format");
+	AssertError("push int8(+-5)\nexit\n", "value format");
 
 	// Push then assert wrong value
 	AssertError("push int8(1)\nassert int8(2)\nexit\n", "assert");
@@ -261,6 +284,9 @@ void assert_test()
 	// Assert fails due to type mismatch
 	AssertError("push float(3.14)\nassert int32(3)\nexit\n", "assert");
 
+	// A float compared with a double is compared at its exact value
+	AssertError("push float(3.40282e38)\nassert double(3.40282e38)\nexit\n", "assert");
+
 	// Assert on empty stack
 	AssertError("assert int8(0)\nexit\n", "empty");
 }
@@ -347,6 +373,10 @@ void add_test()
 	// Mixed float and int
 	AssertResult("push int32(10)\npush float(2.5)\nadd\ndump\nexit\n", "12.5\n");
 
+	// Mixed float and double: the float keeps its exact binary value
+	AssertResult("push float(0.1)\npush double(0)\nadd\ndump\nexit\n", "0.100000001490116\n");
+	AssertResult("push float(0.5)\npush double(0.25)\nadd\ndump\nexit\n", "0.75\n");
+
 	// Edge integer values
 	AssertResult("push int8(127)\npush int8(0)\nadd\ndump\nexit\n", "127\n");
 	AssertResult("push int8(-128)\npush int8(0)\nadd\ndump\nexit\n", "-128\n");
@@ -390,6 +420,9 @@ void sub_test()
 	AssertResult("push int32(10)\npush float(2.5)\nsub\ndump\nexit\n", "7.5\n");
 	AssertResult("push float(2.5)\npush int32(10)\nsub\ndump\nexit\n", "-7.5\n");
 
+	// Mixed float / double
+	AssertResult("push double(0)\npush float(-710.543)\nsub\ndump\nexit\n", "710.543029785156\n");
+
 	// Edge integer values
 	AssertResult("push int8(127)\npush int8(0)\nsub\ndump\nexit\n", "127\n");
 	AssertResult("push int8(-128)\npush int8(0)\nsub\ndump\nexit\n", "-128\n");
@@ -433,6 +466,9 @@ void mul_test()
 	AssertResult("push int32(10)\npush float(2.5)\nmul\ndump\nexit\n", "25\n");
 	AssertResult("push float(2.5)\npush int32(10)\nmul\ndump\nexit\n", "25\n");
 
+	// Mixed float / double: small results are kept, not rounded to 6 decimals
+	AssertResult("push double(0.0000001)\npush float(0.5)\nmul\ndump\nexit\n", "5e-08\n");
+
 	// Zeros
 	AssertResult("push int8(0)\npush int8(100)\nmul\ndump\nexit\n", "0\n");
 	AssertResult("push float(0.0)\npush double(5.5)\nmul\ndump\nexit\n", "0\n");
@@ -705,6 +741,31 @@ void test_sort()
 	// Reverse sorted
 	AssertResult("push int8(5)\npush int8(0)\npush int8(-2)\nsort\ndump\nexit\n", "5\n0\n-2\n");
 
+	// Large stacks are sorted on native keys and must keep equal values in push order
+	static const char *types[] = {"int8", "int16", "int32"};
+	std::string program;
+	std::string expected = "[";
+	for (int i = 0; i < 600; ++i)
+		program += std::string("push ") + types[i % 3] + "(" + std::to_string((i * 37) % 10 - 5) + ")\n";
+	for (int value = 4; value >= -5; --value)
+		for (int i = 599; i >= 0; --i)
+			if ((i * 37) % 10 - 5 == value)
+				expected += std::string(expected.size() > 1 ? "," : "") + "{\"type\":\"" + types[i % 3] + "\",\"value\":" + std::to_string(value) + "}";
+	AssertResultWith(" --dump-format=json", program + "sort\ndump\nexit\n", expected + "]\n");
+
+	program.clear();
+	expected.clear();
+	for (int i = 0; i < 500; ++i)
+		program += (i % 2 ? "push float(" : "push int32(") + std::to_string((i * 131) % 500 - 250) + ")\npush double(" + std::to_string((i * 131) % 500 - 250) + ".5)\n";
+	for (int value = 249; value >= -250; --value)
+	{
+		if (value >= 0)
+			expected += std::to_string(value) + ".5\n" + std::to_string(value) + "\n";
+		else
+			expected += std::to_string(value) + "\n" + std::to_string(value) + ".5\n";
+	}
+	AssertResult(program + "sort\ndump\nexit\n", expected);
+
 	Tester::startTest("sort errors");
 
 	AssertError("sort\ndump\n", "exit");
@@ -726,6 +787,506 @@ void mutliple_errors_tests()
 	AssertError("push int8(32)\npush int8(10)\nadd\nerrorcomment\nmul double(0.0)\n;comment\npush float(42.42.42)\ndump\n", "instruction", "value", "value format");
 }
 
+void bytecode_test()
+{
+	const std::string compileAndRun = " --compile -o /tmp/avm_test.avmc && ./avm /tmp/avm_test.avmc";
+
+	Tester::startTest("bytecode");
+
+	AssertResultWith(compileAndRun, "push int8(2)\npush int8(3)\nadd\ndump\nexit\n", "5\n");
+	AssertResultWith(compileAndRun, "push float(1.5)\n;comment\npush double(2.25)\nmul\nassert double(3.375)\nsort\ndump\nexit\n", "3.375\n");
+	AssertResultWith(compileAndRun, "push int8(72)\nprint\nexit\n", "H\n");
+
+	Tester::startTest("bytecode errors");
+
+	// Execution errors keep their source line
+	AssertErrorWith(compileAndRun, "push int8(1)\n\npop\npop\nexit\n", "line 4: impossible instruction, the stack is empty");
+	AssertErrorWith(compileAndRun, "push int8(1)\n", "exit");
+
+	// Parsing errors are reported at compile time
+	AssertErrorWith(compileAndRun, "push int8(1)\nunknown\nexit\n", "line 2: unknown instruction");
+	std::remove("/tmp/avm_test.avmc");
+}
+
+void optimizer_test()
+{
+	Tester::startTest("optimizer");
+
+	AssertResultWith(" -O1", "push int8(1)\npush int8(2)\nadd\npush int8(3)\nmul\nassert int8(9)\ndump\nexit\n", "9\n");
+	AssertResultWith(" -O1", "push int8(1)\npush int8(2)\nswap\nswap\npush int32(7)\npop\ndump\nexit\n", "2\n1\n");
+	AssertResultWith(" -O1", "push float(1.5)\npush int8(2)\nmul\npush int8(60)\npush int8(5)\nadd\nprint\ndump\nexit\n", "A\n65\n3\n");
+	AssertResultWith(" -O1", "push int8(5)\nexit\npop\npop\n", "");
+
+	Tester::startTest("optimizer errors");
+
+	// Folding never hides an error nor moves it to another line
+	AssertErrorWith(" -O1", "push int8(127)\npush int8(1)\nadd\nexit\n", "line 3: overflow");
+	AssertErrorWith(" -O1", "push int8(1)\npush int8(0)\nmod\nexit\n", "line 3: division or modulo by 0");
+	AssertErrorWith(" -O1", "push int8(3)\nassert int8(4)\nexit\n", "line 2: the execution stoped because of a false assertion");
+	AssertErrorWith(" -O1", "push int8(1)\nswap\nswap\nexit\n", "line 2: the stack is composed of strictly less than two values");
+	AssertErrorWith(" -O1", "push int8(1)\npop\n\n", "line 2: no exit instruction");
+
+	Tester::startTest("stack analysis");
+
+	// A dump between the pushes keeps them apart, so the typed opcodes run
+	AssertResultWith(" -O1", "push int8(1)\ndump\npush int16(2)\nadd\npush float(1.5)\nmul\ndump\nexit\n", "1\n4.5\n");
+	AssertResultWith(" -O1", "push int32(7)\ndump\npush int8(-2)\nmod\npush double(0.5)\ndiv\ndump\nexit\n", "7\n2\n");
+	AssertResultWith(" -O1", "push int8(3)\npush float(2.5)\nsort\ndump\npush int8(1)\nsub\ndump\nexit\n", "3\n2.5\n2\n2.5\n");
+	AssertResultWith(" -O1", "push int8(65)\ndump\nprint\nexit\n", "65\nA\n");
+
+	Tester::startTest("stack analysis errors");
+
+	// A sort between the pushes keeps them apart without printing anything
+	AssertErrorWith(" -O1", "push int8(127)\nsort\npush int8(1)\nadd\nexit\n", "line 4: overflow");
+	AssertErrorWith(" -O1", "push int32(7)\nsort\npush int8(0)\ndiv\nexit\n", "line 4: division or modulo by 0");
+	AssertErrorWith(" -O1", "push int8(1)\npop\npop\nexit\n", "line 3: impossible instruction, the stack is empty");
+	AssertErrorWith(" -O1", "dump\nsort\nswap\nexit\n", "line 3: the stack is composed of strictly less than two values");
+}
+
+void superinstructions_test()
+{
+	Tester::startTest("superinstructions");
+
+	AssertResult("push int8(10)\ndump\npush int8(4)\nadd\npush int16(3)\nmul\npush int8(5)\nsub\npush int8(4)\ndiv\npush int8(4)\nmod\ndump\nexit\n", "10\n1\n");
+	AssertResult("push int8(10)\npush int8(10)\nassert int8(10)\nadd\ndump\nexit\n", "20\n");
+	AssertResultWith(" -O1", "push int8(10)\ndump\npush int8(4)\nswap\nsub\ndump\nexit\n", "10\n-6\n");
+
+	Tester::startTest("superinstructions errors");
+
+	// The fused instruction reports the line of the instruction that failed
+	AssertError("push int8(1)\n\nadd\nexit\n", "line 3: the stack is composed of strictly less than two values");
+	AssertError("push int8(127)\npush int8(1)\nadd\nexit\n", "line 3: overflow");
+	AssertError("push int8(1)\npush int8(2)\nassert int8(3)\nexit\n", "line 3: the execution stoped because of a false assertion");
+	AssertError("push int8(1)\npush int8(2)\nassert int8(2)\n", "line 3: no exit instruction");
+	AssertErrorWith(" -O1", "push int8(-128)\nsort\npush int8(1)\nswap\nsub\nexit\n", "line 5: overflow");
+}
+
+void source_file_test()
+{
+	Tester::startTest("source files");
+
+	// Pipes can't be mapped and are read whole; ";;" only ends the standard input
+	AssertResultWith(" /dev/stdin", "push int8(3)\n;;\ndump\nexit", "3\n");
+	AssertResultWith(" /dev/stdin", "\n; comment\npush int16(7)\npush int16(8)\nadd\ndump\nexit\n\n", "15\n");
+	AssertErrorWith(" /dev/stdin", "push int8(1)\n\npush int8(2\nexit\n", "line 3: syntax error : missing parenthesis");
+	AssertErrorWith(" /dev/stdin", "push int8(1)\npusj\nexit\n", "line 2: unknown instruction --> pusj");
+	AssertErrorWith(" /dev/stdin", "push int9(1)\nexit\n", "line 1: syntax error : unknown type --> int9");
+}
+
+// Writes a program of about 3 MiB, large enough to be split between parsing threads
+static void writeLargeProgram(const std::string& path, bool withErrors)
+{
+	std::ofstream file(path);
+
+	for (int line = 1; line <= 200000; ++line)
+	{
+		if (withErrors && line % 50000 == 0)
+			file << "bogus\n";
+		else if (line % 14 == 7 || line % 14 == 8)
+			file << "; comment\n";
+		else if (line % 2)
+			file << "push int16(" << line % 1000 << ")\n";
+		else
+			file << "pop\n";
+	}
+	file << "push int8(42)\ndump\nexit\n";
+}
+
+void parse_threads_test()
+{
+	const std::string path = "/tmp/avm_parse_threads.avm";
+
+	Tester::startTest("parse threads");
+
+	writeLargeProgram(path, false);
+	AssertResultWith(" --parse-threads 4 " + path, "", "42\n");
+	AssertResultWith(" --parse-threads 3 -O1 " + path, "", "42\n");
+	AssertResultWith(" --parse-threads 0 " + path, "", "Error: --parse-threads expects a positive number of threads.\n");
+
+	Tester::startTest("parse threads errors");
+
+	writeLargeProgram(path, true);
+	AssertErrorWith(" --parse-threads 4 " + path, "", "line 50000: unknown instruction", "line 100000: unknown instruction",
+		"line 150000: unknown instruction", "line 200000: unknown instruction");
+	AssertErrorWith(" --parse-threads 2 " + path, "", "line 50000: unknown instruction", "line 100000: unknown instruction",
+		"line 150000: unknown instruction", "line 200000: unknown instruction");
+	std::remove(path.c_str());
+}
+
+void stream_test()
+{
+	Tester::startTest("stream");
+
+	AssertResultWith(" --stream", "push int8(2)\npush int8(3)\nadd\ndump\nexit\n", "5\n");
+	AssertResultWith(" --stream", "push float(1.5)\n\n;comment\npush double(2.25)\nmul\nassert double(3.375)\nsort\ndump\nexit\n", "3.375\n");
+	// Nothing after exit or ";;" is read
+	AssertResultWith(" --stream", "push int8(72)\nprint\nexit\nbogus\n", "H\n");
+	AssertResultWith(" --stream /dev/stdin", "push int8(1)\n;;\ndump\nexit\n", "1\n");
+	AssertResultWith(" --stream -O1", "exit\n", "Error: --stream runs instructions as they are read and can't be used with --compile, --emit-cpp, -O1, --jit or --parse-threads.\n");
+
+	Tester::startTest("stream errors");
+
+	AssertErrorWith(" --stream", "push int8(1)\npop\npop\nexit\n", "line 3: impossible instruction, the stack is empty");
+	AssertErrorWith(" --stream", "push int8(1)\n;;\nexit\n", "line 1: no exit instruction");
+	// Without --stream nothing runs; with it, instructions before a parsing error have already run
+	// and the following ones are only parsed
+	AssertBoth("push int8(1)\ndump\nbogus\ndump\npush int8(300)\nexit\n", "", "line 3: unknown instruction");
+	AVMResult res = exec("push int8(1)\ndump\nbogus\ndump\npush int8(300)\nexit\n", " --stream");
+	Tester::assertExpectedEqualsActual(std::string("1\n"), res.stdoutStr);
+	Tester::assertExpectedEqualsActual(std::string("Error line 3: unknown instruction --> bogus\nError line 5: overflow --> 300 is not int8 type\n"), res.stderrStr);
+}
+
+void pipeline_test()
+{
+	const std::string path = "/tmp/avm_pipeline.avm";
+
+	Tester::startTest("pipeline");
+
+	AssertResultWith(" --pipeline", "push int8(2)\npush int8(3)\nadd\ndump\nexit\n", "5\n");
+	AssertResultWith(" --pipeline", "push int8(72)\nprint\npush float(1.5)\nsort\ndump\nexit\npop\npop\n", "H\n72\n1.5\n");
+	writeLargeProgram(path, false);
+	AssertResultWith(" --pipeline " + path, "", "42\n");
+
+	Tester::startTest("pipeline errors");
+
+	AssertErrorWith(" --pipeline", "push int8(1)\npop\npop\nexit\n", "line 3: impossible instruction, the stack is empty");
+	AssertErrorWith(" --pipeline", "push int8(1)\nassert int8(1)\n", "line 2: no exit instruction");
+	// The output of instructions run before a parsing error is found is discarded
+	AssertErrorWith(" --pipeline", "push int8(1)\ndump\npop\npop\nexit\npush int8(300)\n", "line 6: overflow --> 300 is not int8 type");
+	writeLargeProgram(path, true);
+	AssertErrorWith(" --pipeline " + path, "", "line 50000: unknown instruction", "line 100000: unknown instruction",
+		"line 150000: unknown instruction", "line 200000: unknown instruction");
+	std::remove(path.c_str());
+}
+
+void flush_test()
+{
+	const std::string program = "push int8(72)\nprint\npush float(0.1)\npush double(-0.00000025)\npush int32(-2147483648)\ndump\nexit\n";
+	const std::string output = "H\n-2147483648\n-2.5e-07\n0.1\n72\n";
+
+	Tester::startTest("flush");
+
+	AssertResultWith(" --flush=line", program, output);
+	AssertResultWith(" --flush=full", program, output);
+	AssertResultWith(" --flush=exit", program, output);
+	AssertResultWith(" --flush=always", program, "Error: --flush expects line, full or exit.\n");
+
+	Tester::startTest("flush errors");
+
+	// Buffered output is written before the error
+	AssertBoth("push int8(1)\ndump\npop\npop\nexit\n", "1\n", "line 4: impossible instruction, the stack is empty");
+	AVMResult res = exec("push int8(1)\ndump\npop\npop\nexit\n", " --flush=exit 2>&1");
+	Tester::assertExpectedEqualsActual(std::string("1\nError line 4: impossible instruction, the stack is empty\n"), res.stdoutStr);
+}
+
+void async_output_test()
+{
+	const std::string path = "/tmp/avm_async_output.avm";
+
+	Tester::startTest("async output");
+
+	AssertResultWith(" --async-output", "push int8(72)\nprint\npush double(0.5)\ndump\nexit\n", "H\n0.5\n72\n");
+	AssertResultWith(" --async-output --flush=line", "push int8(72)\nprint\npush double(0.5)\ndump\nexit\n", "H\n0.5\n72\n");
+	AssertResultWith(" --async-output --stream", "push int16(-7)\ndump\ndump\nexit\n", "-7\n-7\n");
+	writeLargeProgram(path, false);
+	AssertResultWith(" --async-output --flush=full " + path, "", "42\n");
+	std::remove(path.c_str());
+
+	Tester::startTest("async output errors");
+
+	// Errors still come after everything printed before them
+	AVMResult res = exec("push int8(1)\ndump\npop\npop\nexit\n", " --async-output 2>&1");
+	Tester::assertExpectedEqualsActual(std::string("1\nError line 4: impossible instruction, the stack is empty\n"), res.stdoutStr);
+	res = exec("push int8(65)\nprint\nprint\n", " --async-output --stream 2>&1");
+	Tester::assertExpectedEqualsActual(std::string("A\nA\nError line 3: no exit instruction at the end of the program\n"), res.stdoutStr);
+}
+
+void dump_format_test()
+{
+	const std::string program = "push int8(-1)\npush int16(300)\npush float(0.1)\npush double(0.5)\ndump\nexit\n";
+	const std::string hexBytes = " | od -An -tx1 -v | tr -d ' \\n'";
+
+	Tester::startTest("dump formats");
+
+	AssertResultWith(" --dump-format=text", program, "0.5\n0.1\n300\n-1\n");
+	AssertResultWith(" --dump-format=json", program,
+		"[{\"type\":\"double\",\"value\":0.5},{\"type\":\"float\",\"value\":0.1},{\"type\":\"int16\",\"value\":300},{\"type\":\"int8\",\"value\":-1}]\n");
+	AssertResultWith(" --dump-format=json", "dump\npush int32(7)\ndump\nexit\n", "[]\n[{\"type\":\"int32\",\"value\":7}]\n");
+	AssertResultWith(" --dump-format=json", "push double(0.1)\npush double(0.2)\nadd\ndump\nexit\n", "[{\"type\":\"double\",\"value\":0.30000000000000004}]\n");
+	// Count, type bytes, then 8-byte payloads, bottom of the stack first
+	AssertResultWith(" --dump-format=binary" + hexBytes, "push int8(-1)\npush double(0.5)\ndump\nexit\n",
+		"0200000000000000" "0004" "ff00000000000000" "000000000000e03f");
+	AssertResultWith(" --dump-format=binary" + hexBytes, "dump\nexit\n", "0000000000000000");
+	AssertResultWith(" --dump-format=binary --async-output" + hexBytes, "push int16(-2)\npush int32(65536)\ndump\nexit\n",
+		"0200000000000000" "0102" "feff000000000000" "0000010000000000");
+	AssertResultWith(" --dump-format=xml", program, "Error: --dump-format expects text, json or binary.\n");
+
+	Tester::startTest("dump formats errors");
+
+	// An empty dump is output too, so the error can't be reported before running
+	AVMResult res = exec("dump\nswap\nexit\n", " --dump-format=json -O1 --jit 2>&1");
+	Tester::assertExpectedEqualsActual(std::string("[]\nError line 2: the stack is composed of strictly less than two values when an arithmetic instruction is executed --> swap\n"), res.stdoutStr);
+}
+
+static void writeProgram(const std::string& path, const std::string& program)
+{
+	std::ofstream file(path);
+	file << program;
+}
+
+static std::string shell(const std::string& cmd)
+{
+	std::string	out;
+	char		buffer[128];
+	FILE		*pipe = popen(cmd.c_str(), "r");
+
+	if (!pipe)
+		return out;
+	while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+		out += buffer;
+	pclose(pipe);
+	return out;
+}
+
+void batch_test()
+{
+	const std::string dir = "/tmp/avm_batch_";
+	std::string files;
+	std::string output;
+
+	Tester::startTest("batch");
+
+	writeProgram(dir + "add.avm", "push int32(1)\npush int32(2)\nadd\ndump\nexit\n");
+	writeProgram(dir + "print.avm", "push int8(72)\nprint\nexit\n");
+	writeProgram(dir + "pop.avm", "push int8(1)\ndump\npop\npop\nexit\n");
+	writeProgram(dir + "parse.avm", "push int8(1)\ndump\nbogus\nexit\n");
+	AssertResultWith(" --batch " + dir + "add.avm " + dir + "print.avm " + dir + "add.avm", "", "3\nH\n3\n");
+	AssertResultWith(" --batch -O1 --jit --dump-format=json " + dir + "add.avm", "", "[{\"type\":\"int32\",\"value\":3}]\n");
+	// Programs complete out of order on several threads but are written in order
+	for (int i = 0; i < 64; ++i)
+	{
+		writeProgram(dir + std::to_string(i) + ".avm", "push int32(" + std::to_string(i) + ")\ndump\nexit\n");
+		files += " " + dir + std::to_string(i) + ".avm";
+		output += std::to_string(i) + "\n";
+	}
+	AssertResultWith(" --batch --jobs 4" + files, "", output);
+	AssertResultWith(" --batch --manifest - " + dir + "add.avm", dir + "print.avm\n\n" + dir + "add.avm\n", "H\n3\n3\n");
+
+	Tester::startTest("batch errors");
+
+	// Each program keeps its own stack and errors
+	AVMResult res = exec("", " --batch " + dir + "pop.avm " + dir + "add.avm");
+	Tester::assertExpectedEqualsActual(std::string("1\n3\n"), res.stdoutStr);
+	Tester::assertExpectedEqualsActual(std::string("Error line 4: impossible instruction, the stack is empty\n"), res.stderrStr);
+	res = exec("", " --batch --jobs 2 " + dir + "pop.avm " + dir + "parse.avm " + dir + "add.avm " + dir + "missing.avm 2>&1");
+	Tester::assertExpectedEqualsActual(std::string("1\nError line 4: impossible instruction, the stack is empty\n"
+		"Error line 3: unknown instruction --> bogus\n3\nError: could not open file " + dir + "missing.avm\n"), res.stdoutStr);
+	res = exec("", " --batch " + dir + "add.avm " + dir + "pop.avm > /dev/null; echo $?");
+	Tester::assertExpectedEqualsActual(std::string("1\n"), res.stdoutStr);
+	AssertResultWith(" --batch", "", "Error: --batch expects program files.\n");
+	AssertResultWith(" --batch --jobs 0 " + dir + "add.avm", "", "Error: --jobs expects a positive number of threads.\n");
+	AssertResultWith(" --jobs 2 " + dir + "add.avm", "", "Error: --jobs only applies to --batch and --serve, --manifest to --batch.\n");
+	AssertResultWith(" --batch --stream " + dir + "add.avm", "",
+		"Error: --batch keeps the output of each program in memory and can't be used with --compile, --emit-cpp, --stream, --pipeline, --parse-threads, --flush, --async-output or -o.\n");
+	for (const char *name : {"add", "print", "pop", "parse"})
+		std::remove((dir + name + ".avm").c_str());
+	for (int i = 0; i < 64; ++i)
+		std::remove((dir + std::to_string(i) + ".avm").c_str());
+}
+
+void multi_test()
+{
+	Tester::startTest("multi");
+
+	AssertResultWith(" --multi", "push int8(1)\npush int8(2)\nadd\ndump\nexit\n;;\npush int8(72)\nprint\nexit\n;;\n",
+		"program 1 status 0 stdout 2 stderr 0\n3\nprogram 2 status 0 stdout 2 stderr 0\nH\n");
+	// Every program starts on an empty stack, and the last one may end without ";;"
+	AssertResultWith(" --multi", "push int8(1)\nexit\n;;\ndump\nexit\n", "program 1 status 0 stdout 0 stderr 0\nprogram 2 status 0 stdout 0 stderr 0\n");
+	AssertResultWith(" --multi -O1 --jit --dump-format=json", "push int32(7)\ndump\nexit\n;;\n",
+		"program 1 status 0 stdout 29 stderr 0\n[{\"type\":\"int32\",\"value\":7}]\n");
+	AssertResultWith(" --multi", "", "");
+	// Trailing blank lines are not a program of their own
+	AssertResultWith(" --multi", "push int32(1)\ndump\nexit\n;;\n\n", "program 1 status 0 stdout 2 stderr 0\n1\n");
+	AssertResultWith(" --multi", "push int8(1)\nexit\n;;\n  \n\t\npop\nexit\n;;\n\n",
+		"program 1 status 0 stdout 0 stderr 0\nprogram 2 status 1 stdout 0 stderr 57\nError line 1: impossible instruction, the stack is empty\n");
+
+	Tester::startTest("multi errors");
+
+	// Errors are framed with their program and do not stop the next ones
+	AssertResultWith(" --multi", "push int8(1)\ndump\npop\npop\nexit\n;;\npush int8(3)\nbogus\n;;\npush int8(4)\ndump\nexit\n;;\n",
+		"program 1 status 1 stdout 2 stderr 57\n1\nError line 4: impossible instruction, the stack is empty\n"
+		"program 2 status 1 stdout 0 stderr 44\nError line 2: unknown instruction --> bogus\n"
+		"program 3 status 0 stdout 2 stderr 0\n4\n");
+	AVMResult res = exec("push int8(1)\nexit\n;;\npop\nexit\n;;\n", " --multi > /dev/null; echo $?");
+	Tester::assertExpectedEqualsActual(std::string("1\n"), res.stdoutStr);
+	AssertResultWith(" --multi --batch", "", "Error: --batch and --multi can't be used together.\n");
+	AssertResultWith(" --multi /tmp/avm_multi.avm", "",
+		"Error: --multi runs the programs of the standard input one by one and can't be used with a file, --compile, --emit-cpp, --stream, --pipeline, --parse-threads, --flush, --async-output or -o.\n");
+}
+
+void daemon_test()
+{
+	const std::string socket = "/tmp/avm_test.sock";
+	const std::string client = " --client " + socket;
+	const std::string path = "/tmp/avm_daemon.avm";
+
+	Tester::startTest("daemon");
+
+	// The server keeps running in the background until killed
+	exec("", " --serve " + socket + " --jobs 2 > /dev/null 2>&1 & echo $! > /tmp/avm_test.pid; "
+		"while [ ! -S " + socket + " ]; do sleep 0.05; done");
+	writeProgram(path, "push int32(1)\npush int32(2)\nadd\ndump\nexit\n");
+	AssertResultWith(client + " " + path, "", "3\n");
+	AssertResultWith(client, "push int8(72)\nprint\nexit\n;;\n", "H\n");
+	AssertResultWith(client + " -O1 --jit --dump-format=json " + path, "", "[{\"type\":\"int32\",\"value\":3}]\n");
+	AssertResultWith(" --compile -o /tmp/avm_test.avmc " + path + " && ./avm" + client + " /tmp/avm_test.avmc", "", "3\n");
+	// Programs on the same server do not share anything
+	AssertResultWith(client + " " + path + " && ./avm" + client + " " + path, "", "3\n3\n");
+	// Connections left open without a request do not hold the threads
+	std::vector<int> idle;
+	for (int i = 0; i < 4; ++i)
+	{
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		socket.copy(address.sun_path, sizeof(address.sun_path) - 1);
+		idle.push_back(::socket(AF_UNIX, SOCK_STREAM, 0));
+		connect(idle.back(), reinterpret_cast<sockaddr *>(&address), sizeof(address));
+	}
+	Tester::assertExpectedEqualsActual(std::string("3\n"), shell("timeout 5 ./avm" + client + " " + path));
+	for (int fd : idle)
+		close(fd);
+
+	Tester::startTest("daemon errors");
+
+	AssertErrorWith(client, "push int8(1)\npop\npop\nexit\n", "line 3: impossible instruction, the stack is empty");
+	AssertErrorWith(client, "push int8(1)\nbogus\n", "line 2: unknown instruction --> bogus");
+	AssertErrorWith(client + " --stack-reserve 99999999999", "push int8(1)\nexit\n", "Error: the server reserves at most 16777216 stack values.");
+	AVMResult res = exec("push int8(1)\ndump\npop\npop\nexit\n", client + " 2>&1; echo $?");
+	Tester::assertExpectedEqualsActual(std::string("1\nError line 4: impossible instruction, the stack is empty\n1\n"), res.stdoutStr);
+	AssertResultWith(client + " /tmp/avm_missing.avm", "", "Error: could not open file /tmp/avm_missing.avm\n");
+	AssertResultWith(" --serve " + socket, "", "Error: " + socket + " is already served\n");
+	AssertResultWith(" --serve " + socket + " -O1", "", "Error: --serve only takes --jobs, clients send the options of each program.\n");
+	AssertResultWith(client + " --stream", "",
+		"Error: --client runs the program on the server and can't be used with --compile, --emit-cpp, --stream, --pipeline, --parse-threads, --flush, --async-output, -o or --multi.\n");
+	std::system("pid=$(cat /tmp/avm_test.pid); kill $pid; while kill -0 $pid 2> /dev/null; do sleep 0.05; done");
+	AssertResultWith(client + " " + path, "", "Error: could not connect to " + socket + "\n");
+	std::remove(socket.c_str());
+	std::remove(path.c_str());
+	std::remove("/tmp/avm_test.pid");
+	std::remove("/tmp/avm_test.avmc");
+}
+
+// Reads a program on the standard input and runs it through the C API
+static const char *embedProgram =
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include \"avm.h\"\n"
+	"int main(int argc, char **argv)\n"
+	"{\n"
+	"	char text[4096];\n"
+	"	size_t size = fread(text, 1, sizeof(text), stdin);\n"
+	"	t_Avm *avm = avm_create(argc > 1 ? atoi(argv[1]) : 0);\n"
+	"	t_AvmValue value;\n"
+	"	int load = avm_load(avm, text, size);\n"
+	"	int run = avm_run(avm);\n"
+	"	const char *output = avm_output(avm, &size);\n"
+	"	printf(\"load %d run %d\\n\", load, run);\n"
+	"	fwrite(output, 1, size, stdout);\n"
+	"	for (size_t i = 0; avm_stack_value(avm, i, &value) == 0; ++i)\n"
+	"		printf(\"%d %g\\n\", (int)value.type, value.value);\n"
+	"	printf(\"%s\", avm_errors(avm));\n"
+	"	avm_destroy(avm);\n"
+	"	return 0;\n"
+	"}\n";
+
+void library_test()
+{
+	const std::string source = "/tmp/avm_embed.c";
+	const std::string binary = "/tmp/avm_embed";
+	const std::string shared = "/tmp/avm_embed_shared";
+
+	Tester::startTest("library");
+
+	writeProgram(source, embedProgram);
+	// Compiled as C, so the header has to be plain C
+	Tester::assertExpectedEqualsActual(std::string(""),
+		shell("cc -Wall -Wextra -Werror -Iinc -c " + source + " -o /tmp/avm_embed.o 2>&1"
+			" && c++ /tmp/avm_embed.o libavm.a -pthread -o " + binary + " 2>&1"
+			" && c++ /tmp/avm_embed.o -L. -lavm -Wl,-rpath," + shell("pwd | tr -d '\\n'") + " -o " + shared + " 2>&1"));
+	Tester::assertExpectedEqualsActual(std::string("load 0 run 0\n3\n7\n2 3\n0 7\n"),
+		shell("printf 'push int8(7)\npush int32(1)\npush int32(2)\nadd\ndump\nexit\n' | " + binary));
+	Tester::assertExpectedEqualsActual(std::string("load 0 run 0\n42.42\n4 42.42\n"),
+		shell("printf 'push double(40.42)\npush float(2)\nadd\ndump\nexit\n' | " + shared + " 3"));
+	Tester::assertExpectedEqualsActual(std::string("load 0 run 0\n[{\"type\":\"int16\",\"value\":5}]\n1 5\n"),
+		shell("printf 'push int16(5)\ndump\nexit\n' | " + binary + " 4"));
+	// The native code leaves the stack readable as the interpreter does
+	for (std::string flags : {" 0", " 1", " 2", " 3"})
+		Tester::assertExpectedEqualsActual(std::string("load 0 run 0\n0 3\n2 3\n"),
+			shell("printf 'push int32(1)\npush int32(2)\nadd\npush int8(3)\nexit\n' | " + binary + flags));
+	Tester::assertExpectedEqualsActual(std::string("load 0 run -1\n0 100\n0 1\nError line 4: overflow --> 200 is not int8 type\n"),
+		shell("printf 'push int8(1)\npush int8(100)\npush int8(100)\nadd\nexit\n' | " + binary + " 2"));
+	// Programs compiled by avm load as well
+	writeProgram("/tmp/avm_embed.avm", "push int8(72)\nprint\nexit\n");
+	Tester::assertExpectedEqualsActual(std::string("load 0 run 0\nH\n0 72\n"),
+		shell("./avm --compile /tmp/avm_embed.avm -o /tmp/avm_embed.avmc && " + binary + " < /tmp/avm_embed.avmc"));
+
+	Tester::startTest("library errors");
+
+	Tester::assertExpectedEqualsActual(std::string("load 0 run -1\n1\nError line 4: impossible instruction, the stack is empty\n"),
+		shell("printf 'push int8(1)\ndump\npop\npop\nexit\n' | " + binary));
+	Tester::assertExpectedEqualsActual(std::string("load -1 run -1\nError line 2: unknown instruction --> bogus\n"),
+		shell("printf 'push int8(1)\nbogus\nexit\n' | " + shared));
+	Tester::assertExpectedEqualsActual(std::string("load 0 run -1\n0 1\nError line 1: no exit instruction at the end of the program\n"),
+		shell("printf 'push int8(1)\n' | " + binary + " 1"));
+
+	std::remove(source.c_str());
+	std::remove(binary.c_str());
+	std::remove(shared.c_str());
+	std::remove("/tmp/avm_embed.o");
+	std::remove("/tmp/avm_embed.avm");
+	std::remove("/tmp/avm_embed.avmc");
+}
+
+void jit_test()
+{
+	Tester::startTest("jit");
+
+	AssertResultWith(" --jit", "push int8(10)\npush int16(300)\nadd\npush int32(-7)\nmul\ndump\npush int8(4)\ndiv\npush int8(5)\nmod\ndump\nexit\n", "-2170\n-2\n");
+	AssertResultWith(" --jit", "push int32(2147483647)\npush int8(-1)\nswap\npop\npush float(1.5)\nadd\ndump\npush int8(72)\nprint\nexit\n", "0.5\nH\n");
+	AssertResultWith(" --jit", "push double(2.5)\npush int8(3)\npush int16(2)\nsort\nadd\ndump\nexit\npush int8(1)\n", "5.5\n2\n");
+	AssertResultWith(" -O1 --jit", "push int8(1)\npush int8(2)\nadd\npush int8(4)\nmul\ndump\nexit\n", "12\n");
+
+	Tester::startTest("jit errors");
+
+	AssertErrorWith(" --jit", "push int8(127)\npush int8(1)\nadd\nexit\n", "line 3: overflow --> 128 is not int8 type");
+	AssertErrorWith(" --jit", "push int32(-2147483648)\npush int8(1)\nsub\nexit\n", "line 3: underflow");
+	AssertErrorWith(" --jit", "push int16(5)\npush int8(0)\nmod\nexit\n", "line 3: division or modulo by 0");
+	AssertErrorWith(" --jit", "push int32(65536)\npush int32(65536)\nmul\nexit\n", "line 3: overflow --> 4294967296 is not int32 type");
+	AssertErrorWith(" --jit", "push int16(-300)\npush int16(200)\nmul\nexit\n", "line 3: underflow --> -60000 is not int16 type");
+	AssertErrorWith(" --jit", "push int32(-2147483648)\npush int8(-1)\ndiv\nexit\n", "line 3: overflow --> 2147483648 is not int32 type");
+	AssertResultWith(" --jit", "push int32(-2147483648)\npush int8(-1)\nmod\ndump\nexit\n", "0\n");
+	AssertErrorWith(" --jit", "push int8(1)\npop\npop\nexit\n", "line 3: impossible instruction, the stack is empty");
+	AssertErrorWith(" --jit", "push int8(1)\nassert int8(1)\n", "line 2: no exit instruction");
+}
+
+void emit_cpp_test()
+{
+	const std::string emitAndRun = " --emit-cpp -o /tmp/avm_test.cpp && c++ -std=c++17 /tmp/avm_test.cpp -o /tmp/avm_test_bin && /tmp/avm_test_bin";
+
+	Tester::startTest("emit-cpp");
+
+	AssertResultWith(emitAndRun, "push int8(10)\npush int16(300)\nadd\npush float(0.1)\nmul\ndump\npush int8(33)\nprint\nexit\n", "31\n!\n");
+	AssertResultWith(emitAndRun, "push double(2.5)\npush int32(-2147483648)\npush int8(2)\nsort\ndump\nadd\nswap\npop\nassert double(4.5)\nexit\n", "2.5\n2\n-2147483648\n");
+
+	Tester::startTest("emit-cpp errors");
+
+	AssertErrorWith(emitAndRun, "push int8(100)\npush int8(100)\nadd\nexit\n", "line 3: overflow --> 200 is not int8 type");
+	AssertErrorWith(emitAndRun, "push float(1.5)\npush int8(0)\ndiv\nexit\n", "line 3: division or modulo by 0");
+	AssertErrorWith(emitAndRun, "push int8(1)\nassert int8(1)\n", "line 2: no exit instruction");
+	std::remove("/tmp/avm_test.cpp");
+	std::remove("/tmp/avm_test_bin");
+}
+
 bool fileExistsAndExecutable(const std::string& filename)
 {
 	return (access(filename.c_str(), F_OK | X_OK) == 0); // F_OK checks existence, X_OK checks execute permission
@@ -756,6 +1317,23 @@ int main()
 	test_swap();
 	test_sort();
 	mutliple_errors_tests();
+	std::cout << std::endl << std::endl << "########## OPTIONS ##########" << std::flush;
+	bytecode_test();
+	optimizer_test();
+	superinstructions_test();
+	source_file_test();
+	parse_threads_test();
+	stream_test();
+	pipeline_test();
+	flush_test();
+	async_output_test();
+	dump_format_test();
+	batch_test();
+	multi_test();
+	daemon_test();
+	library_test();
+	jit_test();
+	emit_cpp_test();
 	Tester::printResults();
 	return 0;
 }